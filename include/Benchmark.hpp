@@ -0,0 +1,98 @@
+#ifndef Benchmark_HPP
+#define Benchmark_HPP
+
+#include "Graphics.hpp"
+#include "Testbed.hpp"
+#include "FrameStats.hpp"
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+class Camera;
+
+namespace Testbed {
+
+// Camera pose at a point in time along a path
+struct CameraKey
+{
+    double time;
+    glm::vec3 position;
+    float pitch;
+    float yaw;
+};
+
+// A recorded camera path split into named segments
+// File format is one "segment <name>" or "<time> <x> <y> <z> <pitch> <yaw>" per line
+struct CameraPath
+{
+    struct Segment
+    {
+        std::string name;
+        double start;   // Time of the first key in the segment
+    };
+
+    std::vector<CameraKey> keys;
+    std::vector<Segment> segments;
+
+    bool load(const char* filename);
+    bool save(const char* filename) const;
+
+    // Linearly interpolated pose at time t, clamped to the ends of the path
+    CameraKey sample(double t) const;
+    // Index of the segment containing time t
+    size_t segmentAt(double t) const;
+    double duration() const { return keys.empty() ? 0.0 : keys.back().time; }
+};
+
+// Records the camera path of an interactive run, or replays one with a fixed
+// timestep and reports CPU and GPU frame times for each segment of the path
+class Benchmark
+{
+public:
+    Benchmark() : mode(NONE), time(0.0), frame(0) { }
+
+    // Starts recording or replaying if requested by the options
+    void initialize(const Options& options);
+
+    bool isRecording() const { return mode == RECORD; }
+    bool isReplaying() const { return mode == REPLAY; }
+
+    // Returns the timestep to simulate this frame, fixed while replaying
+    double step(double dt);
+
+    // Records the camera pose, or overrides it with the path when replaying
+    void apply(Camera& camera);
+
+    // Bracket the GPU work of a frame
+    void beginFrame();
+    void endFrame();
+
+    // Saves the recorded path or writes the benchmark report
+    void finish();
+private:
+    enum Mode { NONE, RECORD, REPLAY };
+    enum { QUERIES = 4 };
+
+    struct Segment
+    {
+        Segment() : cpu(16384), gpu(16384) { }
+        FrameStats cpu;
+        FrameStats gpu;
+    };
+
+    void resolve(int index, bool wait);
+    bool writeReport(const char* filename) const;
+
+    Mode mode;
+    Options options;
+    CameraPath path;
+    std::vector<Segment> results;
+    double time;            // Simulated time along the path
+    unsigned frame;
+    GLuint queries[QUERIES];
+    int querySegment[QUERIES]; // Segment each query was issued in, -1 if none
+};
+
+} // Testbed
+
+#endif // Benchmark_HPP
@@ -17,6 +17,8 @@ public:
 
     glm::mat4 getCameraMatrix();
     glm::vec3 getPosition() { return position; }
+    float getPitch() { return pitch; }
+    float getYaw() { return yaw; }
 private:
     glm::vec3 position;
     float pitch, yaw;
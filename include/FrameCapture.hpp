@@ -0,0 +1,68 @@
+#ifndef FrameCapture_HPP
+#define FrameCapture_HPP
+
+#include "Graphics.hpp"
+#include "Jobs.hpp"
+#include <string>
+#include <vector>
+
+class RenderTarget;
+
+namespace Testbed {
+
+// Writes frames to disk without stalling the frame loop. Each capture is
+// read back into the next pixel pack buffer of a ring and fenced, update()
+// copies out buffers whose fence has passed and hands them to the job
+// workers to encode. When the next buffer is still in flight, or too many
+// encodes are queued, the capture is dropped instead of waiting.
+class FrameCapture
+{
+public:
+    FrameCapture() : next(0), maxEncodes(0), captured(0), dropped(0) { }
+    ~FrameCapture() { release(); }
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // Allocates the buffer ring, requires a current context and Jobs workers
+    void initialize(unsigned buffers=3, unsigned maxEncodes=8);
+
+    // Queues a readback of the first color attachment of target, or of the
+    // back buffer for the screen. Files ending in .ppm are written as raw
+    // binary PPM, which is much faster than PNG. Returns false if dropped.
+    bool capture(const RenderTarget& target, int width, int height, const std::string& filename);
+
+    // Hands finished readbacks to the workers, call once per frame
+    void update();
+
+    // Waits for every readback and encode, for shutdown
+    void finish();
+
+    unsigned getCaptured() const { return captured; }
+    unsigned getDropped() const { return dropped; }
+
+    void release();
+private:
+    struct Slot
+    {
+        GLuint buffer;
+        size_t size;        // Bytes allocated for buffer
+        GLsync fence;       // Set while the readback is in flight
+        int width;
+        int height;
+        std::string filename;
+    };
+
+    void collect(Slot& slot);
+    void pruneEncodes();
+
+    std::vector<Slot> slots;
+    std::vector<Jobs::Job> encodes;     // Queued or running
+    unsigned next;                      // Slot the next capture reads into
+    unsigned maxEncodes;
+    unsigned captured;
+    unsigned dropped;
+};
+
+} // Testbed
+
+#endif // FrameCapture_HPP
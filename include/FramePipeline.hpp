@@ -0,0 +1,125 @@
+#ifndef FramePipeline_HPP
+#define FramePipeline_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace Testbed {
+
+// Double-buffered hand-off of frame packets between a simulation worker and
+// the GL thread. While the GL thread submits packet N the worker fills packet
+// N+1, trading one frame of latency for overlapping CPU and GPU submission.
+// Without threading the producer runs inline and behaves like a serial loop.
+template <typename Packet>
+class FramePipeline
+{
+public:
+    typedef std::function<void(Packet&)> Producer;
+    typedef std::function<void()> Sync;
+
+    FramePipeline() : front(0), busy(false), quit(false), threaded(false) { }
+    ~FramePipeline() { stop(); }
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    // produce fills a packet, on the worker when threaded. sync runs on the
+    // calling thread while the worker is idle, so it may safely exchange
+    // state such as input with the producer.
+    void start(Producer produce, Sync sync=nullptr, bool threaded=true);
+
+    // Waits for the packet in flight, starts the next one and returns the
+    // newest complete packet. Call once per frame from the GL thread.
+    Packet& swap();
+
+    // Finishes the packet in flight and joins the worker
+    void stop();
+
+    bool isThreaded() const { return threaded; }
+private:
+    void run();
+
+    Producer produce;
+    Sync sync;
+    Packet packets[2];
+    int front;          // Packet owned by the GL thread
+    bool busy;          // Worker is filling the back packet
+    bool quit;
+    bool threaded;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable kick;
+    std::condition_variable done;
+};
+
+template <typename Packet>
+void FramePipeline<Packet>::start(Producer produce, Sync sync, bool threaded)
+{
+    stop();
+    this->produce = produce;
+    this->sync = sync;
+    this->threaded = threaded;
+    front = 0;
+    busy = false;
+    quit = false;
+
+    // Prime the back packet so the first swap has a packet to return
+    if (sync) sync();
+    produce(packets[front ^ 1]);
+    if (threaded)
+        worker = std::thread(&FramePipeline::run, this);
+}
+
+template <typename Packet>
+Packet& FramePipeline<Packet>::swap()
+{
+    if (!threaded)
+    {
+        if (sync) sync();
+        produce(packets[front]);
+        return packets[front];
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return !busy; });
+    front ^= 1;
+    if (sync) sync();
+    busy = true;
+    kick.notify_one();
+    return packets[front];
+}
+
+template <typename Packet>
+void FramePipeline<Packet>::stop()
+{
+    if (!worker.joinable()) return;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return !busy; });
+        quit = true;
+        kick.notify_one();
+    }
+    worker.join();
+}
+
+template <typename Packet>
+void FramePipeline<Packet>::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        kick.wait(lock, [this] { return busy || quit; });
+        if (quit) return;
+        Packet& back = packets[front ^ 1];
+        lock.unlock();
+        produce(back);
+        lock.lock();
+        busy = false;
+        done.notify_one();
+    }
+}
+
+} // Testbed
+
+#endif // FramePipeline_HPP
@@ -0,0 +1,66 @@
+#ifndef FrameStats_HPP
+#define FrameStats_HPP
+
+#include <vector>
+#include <stddef.h>
+
+namespace Testbed {
+
+// Frame time statistics over a fixed-size ring of recent frames.
+// Frames are added in seconds, budgets and everything reported are in milliseconds.
+class FrameStats
+{
+public:
+    struct Summary
+    {
+        size_t frames;      // Frames currently in the ring
+        double mean;
+        double p50;
+        double p95;
+        double p99;
+        double max;
+        unsigned hitches;   // Frames in the ring over budget
+    };
+
+    // The ring keeps at least one frame
+    FrameStats(size_t capacity=1024, double budget=1000.0/60.0);
+
+    // Record one frame time in seconds, as passed to update()
+    void add(double dt);
+
+    // Frames longer than budget count as hitches
+    void setBudget(double ms) { budget = ms; }
+    double getBudget() const { return budget; }
+
+    Summary summarize() const;
+
+    // Counts of frames in bucket-wide bins starting at 0, last bin holds the overflow
+    std::vector<unsigned> histogram(double bucket=1.0, size_t bins=50) const;
+
+    // Totals since construction or reset, not limited to the ring
+    size_t getTotalFrames() const { return totalFrames; }
+    unsigned getTotalHitches() const { return totalHitches; }
+
+    void print() const;
+
+    // Writes the run summary; .json gets the histogram and ring, anything else
+    // appends a row to a CSV file so runs from several builds collect in one place
+    bool write(const char* filename, const char* label=nullptr) const;
+
+    void reset();
+private:
+    bool writeCSV(const char* filename, const char* label) const;
+    bool writeJSON(const char* filename, const char* label) const;
+
+    std::vector<double> times;  // Ring of frame times
+    size_t next;
+    size_t count;
+    double budget;
+    size_t totalFrames;
+    unsigned totalHitches;
+    double totalTime;
+};
+
+} // Testbed
+
+#endif // FrameStats_HPP
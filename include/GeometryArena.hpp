@@ -0,0 +1,112 @@
+#ifndef GeometryArena_HPP
+#define GeometryArena_HPP
+
+#include "Graphics.hpp"
+#include "Buffer.hpp"
+#include "Mesh.hpp"
+#include "Testbed.hpp"
+#include <vector>
+
+namespace Graphics {
+
+// Static meshes of one vertex format suballocated from a single vertex and
+// index buffer behind one vertex array. Everything drawn with the same shader
+// is submitted as one bucket of commands: a single glMultiDrawElementsIndirect
+// on GL 4.3 or ARB_multi_draw_indirect, otherwise one base-vertex draw per
+// command without rebinding anything in between.
+class GeometryArena
+{
+public:
+    // Where a mesh lives in the arena
+    struct Range
+    {
+        GLuint count;       // Indices
+        GLuint firstIndex;
+        GLint baseVertex;
+    };
+
+    // Layout of DrawElementsIndirectCommand, uploaded as is
+    struct Command
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    GeometryArena() : geometry{{0}}, commandBuffer(0), indirectCapacity(0), stride(0), vertices(0), vertexCapacity(0),
+                      indices(0), indexCapacity(0), firstInstanceLocation(0), instanceOffset(0),
+                      multiDraw(false), baseInstance(false) { }
+    ~GeometryArena() { release(); }
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    // Buffers start with room for the given counts and double when full.
+    // indirect=false keeps to the GL 3.3 path even where multi-draw exists.
+    void initialize(const std::vector<Attrib>& attributes, size_t stride, size_t vertexCapacity, size_t indexCapacity,
+                    bool indirect=true);
+
+    // Copies a mesh of the arena's vertex format into the shared buffers.
+    // Only triangle lists, strips would need a restart index per bucket.
+    Range add(const Buffer& vertices, const std::vector<GLuint>& indices);
+
+    template <class Vertex>
+    Range add(const IndexedMesh<Vertex>& mesh)
+    {
+        Testbed::assert(!mesh.strip, "[GeometryArena] Strips can't share a bucket with triangle lists");
+        return add(mesh.vertices, mesh.indices);
+    }
+
+    // Unindexed meshes are given sequential indices
+    template <class Vertex>
+    Range add(const Mesh<Vertex>& mesh)
+    {
+        std::vector<GLuint> sequence(mesh.vertices.size());
+        for (size_t i = 0; i < sequence.size(); i++) sequence[i] = i;
+        return add(mesh.vertices, sequence);
+    }
+
+    // Per-instance attributes from firstLocation on, commands pick their
+    // instances with baseInstance
+    void setInstanceFormat(GLuint firstLocation, const std::vector<Attrib>& format, size_t stride);
+    void updateInstances(const Buffer& instances);
+
+    // Command drawing the range, instances from baseInstance on
+    static Command command(const Range& range, GLuint instances=1, GLuint baseInstance=0)
+    {
+        return {range.count, instances, range.firstIndex, range.baseVertex, baseInstance};
+    }
+
+    // Submits a bucket, the caller binds the shader. Commands are uploaded
+    // to the indirect buffer every call, it is invalidated rather than waited on.
+    void draw(const std::vector<Command>& commands);
+
+    bool isIndirect() const { return multiDraw; }
+    size_t getVertexCount() const { return vertices; }
+    size_t getIndexCount() const { return indices; }
+
+    void release();
+private:
+    // Replaces buffer with one of size bytes holding its first used bytes
+    void grow(GLuint& buffer, size_t used, size_t size);
+
+    InstancedSurface geometry;  // The shared vertex array and buffers, plus instances if any
+    std::vector<Attrib> attributes;
+    std::vector<Attrib> instanceAttributes;
+    GLuint commandBuffer;       // Draw indirect buffer
+    size_t indirectCapacity;    // In commands
+    size_t stride;              // Bytes per vertex
+    size_t vertices;            // Used so far
+    size_t vertexCapacity;
+    size_t indices;
+    size_t indexCapacity;
+    GLuint firstInstanceLocation;
+    GLuint instanceOffset;      // Instance the attributes point at when base instances are emulated
+    bool multiDraw;             // glMultiDrawElementsIndirect is available
+    bool baseInstance;          // Base instances can be passed to draws, otherwise attributes are offset
+};
+
+} // Graphics
+
+#endif // GeometryArena_HPP
@@ -0,0 +1,85 @@
+#ifndef GoldenTest_HPP
+#define GoldenTest_HPP
+
+#include "Graphics.hpp"
+#include "Testbed.hpp"
+#include "Benchmark.hpp"
+#include <string>
+#include <vector>
+
+class Camera;
+class RenderTarget;
+
+namespace Testbed {
+
+// Renders a fixed set of camera poses and compares each frame against a
+// reference image. Poses are the segments of <dir>/poses.txt, in the camera
+// path format, and the first key of a segment gives its position and the
+// animation time. Each pose is held long enough for temporal effects and
+// profiler queries to settle, then the GPU time of every profiler zone is
+// recorded next to the result of comparing the frame with <dir>/<pose>.png.
+class GoldenTest
+{
+public:
+    GoldenTest() : running(false), update(false), pose(0), frame(0), failures(0) { }
+
+    // Starts if options.golden names a directory with a poses file
+    void initialize(const Options& options);
+
+    bool isRunning() const { return running; }
+
+    // Returns the timestep to simulate this frame, fixed while running
+    double step(double dt);
+
+    // Moves the camera to the current pose
+    void apply(Camera& camera);
+
+    // Animation time of the current pose
+    float getTime() const;
+
+    // Call after the frame is drawn and before the swap. Reads back target
+    // on the last frame of a pose and moves on to the next one.
+    void endFrame(const RenderTarget& target, int width, int height);
+
+    // Prints the results and writes the report, if one was asked for
+    void finish();
+
+    // False if any pose differed from its reference or had none
+    bool passed() const { return failures == 0; }
+private:
+    enum { SETTLE = 8, MEASURE = 16 };  // Frames held before timing, and timed
+
+    struct Zone
+    {
+        std::string name;
+        int depth;
+        double avg;
+        double max;
+    };
+
+    struct Result
+    {
+        std::string name;
+        const char* status;     // pass, fail, missing, size or updated
+        double bad;             // Fraction of pixels outside the tolerance
+        double psnr;            // Over RGB in dB, 0 when not compared
+        std::vector<Zone> zones;
+    };
+
+    void compare(Result& result, const std::vector<unsigned char>& rgba, int width, int height);
+    bool writeReport(const char* filename) const;
+
+    Options options;
+    CameraPath poses;
+    std::string directory;
+    std::vector<Result> results;
+    bool running;
+    bool update;            // Write the reference images instead of comparing
+    size_t pose;
+    unsigned frame;         // Frames drawn of the current pose
+    unsigned failures;
+};
+
+} // Testbed
+
+#endif // GoldenTest_HPP
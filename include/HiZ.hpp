@@ -0,0 +1,39 @@
+#ifndef HiZ_HPP
+#define HiZ_HPP
+
+#include "Graphics.hpp"
+#include "RenderTarget.hpp"
+#include "Shader.hpp"
+
+// Min-depth pyramid built from a depth texture. Each texel of level n holds
+// the nearest depth under it in level n-1, so a ray found to be in front of a
+// texel can skip the whole block of pixels it covers.
+class HiZ
+{
+public:
+    HiZ() : vao(0) { }
+    ~HiZ() { release(); }
+
+    // Loads the reduction shader, requires a current context
+    void initialize();
+    void reloadShaders();
+
+    // Reallocates the pyramid for a new framebuffer size
+    void resize(GLuint width, GLuint height);
+
+    // Copies depth into level 0 and reduces it down to 1x1
+    void build(GLuint depthTexture);
+
+    // 0 until the first resize
+    GLuint getTexture() { return pyramid.getNumTextures() ? pyramid.getTexture(0) : 0; }
+    RenderTarget& getTarget() { return pyramid; }
+    int getLevels() const { return pyramid.getLevels(); }
+
+    void release();
+private:
+    RenderTarget pyramid;   // Single R32F color attachment with a full mip chain
+    Graphics::Shader shader;
+    GLuint vao;             // Empty, the full screen triangle comes from gl_VertexID
+};
+
+#endif // HiZ_HPP
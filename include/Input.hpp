@@ -3,12 +3,37 @@
 
 #include "Buttons.hpp"
 #include <functional>
+#include <stddef.h>
 
 namespace Input
 {
-// Poll system for events
+// Input event as recorded by the window callbacks
+struct Event
+{
+    enum Type { MOUSE_MOVE, KEY_PRESS, KEY_RELEASE, BUTTON_PRESS, BUTTON_RELEASE, RESIZE };
+
+    Type type;
+    double time;        // Testbed::getTime() when the event arrived
+    union
+    {
+        struct { double x, y, dx, dy; } mouse;
+        Key key;
+        Button button;
+        struct { int width, height; } size;
+    };
+};
+
+// Poll system for events, then run the registered callbacks for the new ones
 void poll();
 
+// Copies up to max events recorded since the last drain into events, oldest
+// first, and returns how many were copied. Events stay in a fixed ring, so
+// draining is optional and never allocates.
+size_t drainEvents(Event* events, size_t max);
+
+// Events overwritten before they were drained
+size_t getDroppedEvents();
+
 
 // Accessor for key state
 bool isKeyPressed(Key key);
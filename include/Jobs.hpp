@@ -0,0 +1,46 @@
+#ifndef Jobs_HPP
+#define Jobs_HPP
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <stddef.h>
+
+namespace Testbed {
+namespace Jobs {
+
+class Task;
+typedef std::shared_ptr<Task> Job;
+
+// Start the worker threads, 0 uses one less than the number of cores
+void initialize(unsigned threads=0);
+
+// Finish queued work and join the workers
+void shutdown();
+
+// Number of worker threads, not counting threads that only submit and wait
+unsigned getThreadCount();
+
+// Schedule fn to run as soon as a thread is free
+Job run(std::function<void()> fn);
+
+// Schedule fn to run once every dependency has finished
+Job run(std::function<void()> fn, const std::vector<Job>& dependencies);
+
+// Schedule fn to run after job finishes
+Job then(const Job& job, std::function<void()> fn);
+
+bool isDone(const Job& job);
+
+// Block until job finishes, running other queued jobs in the meantime
+void wait(const Job& job);
+void wait(const std::vector<Job>& jobs);
+
+// Calls fn(first, last) over [begin, end) split into chunks of at most grain
+// elements and returns when all of them have run. The caller takes part.
+void parallelFor(size_t begin, size_t end, size_t grain, std::function<void(size_t, size_t)> fn);
+
+} // Jobs
+} // Testbed
+
+#endif // Jobs_HPP
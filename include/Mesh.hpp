@@ -5,10 +5,16 @@
 #include "Buffer.hpp"
 #include <vector>
 
+// Components and GL type of a vertex attribute. Normalized integer types map
+// to [0, 1] or [-1, 1]. Attributes without a placed offset follow right
+// after the previous one, VertexFormat.hpp places every attribute.
 struct Attrib
 {
     GLuint size;
     GLenum type;
+    GLboolean normalized;
+    GLuint offset;
+    GLboolean placed;   // offset is used even when 0
 };
 
 template<class Vertex>
@@ -18,12 +24,16 @@ struct Mesh
     std::vector<Vertex> vertices;
 };
 
+// Separates triangle strips in an index buffer
+const GLuint RESTART_INDEX = 0xffffffff;
+
 template<class Vertex>
 struct IndexedMesh
 {
     std::vector<Attrib> attributes;
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
+    bool strip;     // Indices are triangle strips separated by RESTART_INDEX
 };
 
 namespace Graphics
@@ -31,15 +41,40 @@ namespace Graphics
 
     struct Surface
     {
-        GLenum prim;// Primitive type (currently only GL_TRIANGLES)
+        GLenum prim;// Primitive type, GL_TRIANGLES or GL_TRIANGLE_STRIP
         GLuint vao; // Vertex array object
         GLuint vbo; // Vertex buffer handle
         GLuint ibo; // Index buffer handle
         GLsizei num;// Number of elements or vertices
+        GLint base; // First vertex, for surfaces sharing a buffer
+        GLintptr indexOffset; // Byte offset of the first index in ibo
+        GLenum indexType;     // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    };
+
+    // A surface drawn many times in one call. Per-instance attributes come
+    // from a second buffer, in the shader locations after the vertex ones.
+    struct InstancedSurface
+    {
+        Surface surface;    // Its vertex array also reads the instance buffer
+        GLuint instances;   // Instance buffer handle
+        GLsizei capacity;   // Instances the buffer holds before it has to grow
+        GLsizei count;      // Instances given to the last update
+        GLsizei stride;     // Bytes per instance
     };
 
+    // Bytes taken by one attribute
+    GLuint getAttribBytes(const Attrib& attrib);
+
+    // Enables the attributes on the bound vertex array from location first
+    // on, reading vertices of stride bytes from the bound array buffer,
+    // starting base bytes in. A divisor of 1 advances them once per instance.
+    void setVertexAttributes(const std::vector<Attrib>& attributes, size_t stride, GLuint first=0, GLuint divisor=0,
+                             size_t base=0);
+
     Surface createSurface(const Buffer& data, const std::vector<Attrib>& attributes);
-    Surface createSurface(const Buffer& data, const std::vector<Attrib>& attributes, const std::vector<GLuint>& indices);
+    // Indices are stored in 16 bits when every vertex fits
+    Surface createSurface(const Buffer& data, const std::vector<Attrib>& attributes, const std::vector<GLuint>& indices,
+                          GLenum prim=GL_TRIANGLES);
 
     template <class Vertex>
     Surface createSurface(const Mesh<Vertex>& mesh) 
@@ -50,12 +85,41 @@ namespace Graphics
     template <class Vertex>
     Surface createSurface(const IndexedMesh<Vertex>& mesh)
     {
-        return createSurface(Buffer(mesh.vertices), mesh.attributes, mesh.indices);
+        return createSurface(Buffer(mesh.vertices), mesh.attributes, mesh.indices,
+                             mesh.strip ? GL_TRIANGLE_STRIP : GL_TRIANGLES);
+    }
+
+    // Takes over surface, whose vertex attributes end before firstLocation
+    InstancedSurface createInstancedSurface(const Surface& surface, GLuint firstLocation,
+                                            const std::vector<Attrib>& attributes, size_t stride, GLsizei capacity);
+
+    template <class Instance, class Vertex>
+    InstancedSurface createInstancedSurface(const Mesh<Vertex>& mesh, const std::vector<Attrib>& attributes, GLsizei capacity)
+    {
+        return createInstancedSurface(createSurface(mesh), mesh.attributes.size(), attributes, sizeof(Instance), capacity);
+    }
+
+    template <class Instance, class Vertex>
+    InstancedSurface createInstancedSurface(const IndexedMesh<Vertex>& mesh, const std::vector<Attrib>& attributes, GLsizei capacity)
+    {
+        return createInstancedSurface(createSurface(mesh), mesh.attributes.size(), attributes, sizeof(Instance), capacity);
     }
 
+    // Replaces the instances to draw. The buffer is invalidated and written
+    // in place, it is only reallocated when more instances than ever arrive.
+    void updateInstances(InstancedSurface& surface, const Buffer& instances);
+
+    // Two triangles per cell of a width x height vertex grid, row by row
+    std::vector<GLuint> gridIndices(unsigned width, unsigned height);
+
     void drawSurface(const Surface& surface);
 
+    // Draws the surface instances times in one call
+    void drawSurfaceInstanced(const Surface& surface, GLsizei instances);
+    void drawSurfaceInstanced(const InstancedSurface& surface);
+
     void deleteSurface(Surface& surface);
+    void deleteSurface(InstancedSurface& surface);
 }
 
 #endif // Mesh_HPP
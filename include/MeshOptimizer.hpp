@@ -0,0 +1,69 @@
+#ifndef MeshOptimizer_HPP
+#define MeshOptimizer_HPP
+
+#include "Graphics.hpp"
+#include "Mesh.hpp"
+#include <stdio.h>
+#include <vector>
+
+namespace Graphics
+{
+
+// How often the post-transform cache misses while drawing an index buffer,
+// simulated as a FIFO of cacheSize vertices
+struct CacheStats
+{
+    size_t triangles;
+    double acmr;    // Vertices transformed per triangle, 3 at worst and near 0.5 for a good grid order
+    double atvr;    // Vertices transformed per vertex used, 1 at best
+};
+
+CacheStats analyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, bool strip=false, unsigned cacheSize=16);
+
+// Reorders triangles to reuse recently transformed vertices (Forsyth's linear
+// speed algorithm). Indices are a triangle list.
+void optimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount);
+
+// Renumbers vertices in the order they are first used so fetches walk the
+// vertex buffer forward. Returns the new index of every old vertex,
+// RESTART_INDEX for unused ones.
+std::vector<GLuint> optimizeVertexFetch(std::vector<GLuint>& indices, size_t vertexCount);
+
+// Joins triangles sharing an edge into strips separated by RESTART_INDEX,
+// keeping their winding and mostly their order
+std::vector<GLuint> stripify(const std::vector<GLuint>& indices);
+
+// Cache and fetch order, optionally strips, then prints the cache statistics before and after
+template <class Vertex>
+void optimizeMesh(IndexedMesh<Vertex>& mesh, const char* name, bool strip=false)
+{
+    if (mesh.strip) return;
+    CacheStats before = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+    optimizeVertexCache(mesh.indices, mesh.vertices.size());
+    std::vector<GLuint> remap = optimizeVertexFetch(mesh.indices, mesh.vertices.size());
+    std::vector<Vertex> vertices(mesh.vertices.size());
+    size_t used = 0;
+    for (size_t i = 0; i < remap.size(); i++)
+    {
+        if (remap[i] == RESTART_INDEX) continue;
+        vertices[remap[i]] = mesh.vertices[i];
+        used++;
+    }
+    vertices.resize(used);
+    mesh.vertices.swap(vertices);
+
+    if (strip)
+    {
+        mesh.indices = stripify(mesh.indices);
+        mesh.strip = true;
+    }
+
+    CacheStats after = analyzeVertexCache(mesh.indices, mesh.vertices.size(), mesh.strip);
+    printf("[Mesh] %s: %zu triangles in %zu indices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+           name, after.triangles, mesh.indices.size(), before.acmr, after.acmr, before.atvr, after.atvr);
+}
+
+}
+
+#endif // MeshOptimizer_HPP
@@ -0,0 +1,60 @@
+#ifndef Profiler_HPP
+#define Profiler_HPP
+
+#include "Graphics.hpp"
+#include <vector>
+
+namespace Graphics
+{
+namespace Profiler
+{
+    // Rolling timings of a named zone in milliseconds
+    struct ZoneStats
+    {
+        const char* name;   // Valid until shutdown
+        int depth;      // Nesting level, 0 for top level zones
+        double min;
+        double avg;
+        double max;
+        int samples;    // Number of frames in the rolling window
+        double mean;    // Over every frame since the last reset
+        int frames;     // Frames in mean
+    };
+
+    // Allocate the query ring, requires a current context
+    void initialize();
+
+    // Collect results from the oldest frame in the ring and start a new frame
+    void beginFrame();
+    void endFrame();
+
+    // Open and close a named zone, zones may nest
+    void begin(const char* name);
+    void end();
+
+    // Copy the current statistics for every zone seen so far
+    std::vector<ZoneStats> getStats();
+
+    // Forget the samples collected so far, e.g. when the scene changes
+    void reset();
+
+    // Print the statistics as an indented tree
+    void print();
+
+    // Release queries
+    void shutdown();
+}
+
+// Scoped zone, closes itself at the end of the enclosing block
+class ProfileZone
+{
+public:
+    ProfileZone(const char* name) { Profiler::begin(name); }
+    ~ProfileZone() { Profiler::end(); }
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+};
+
+}
+
+#endif // Profiler_HPP
@@ -0,0 +1,148 @@
+#ifndef RenderGraph_HPP
+#define RenderGraph_HPP
+
+#include "Graphics.hpp"
+#include "RenderTarget.hpp"
+#include <functional>
+#include <map>
+#include <vector>
+
+// Frame graph over RenderTarget. Every frame the passes are declared again
+// with the resources they sample and the target they render into, then
+// execute() works out what actually has to happen:
+//  - passes whose output nothing reads are dropped
+//  - transient targets are allocated for the span of passes that use them,
+//    and targets with equal descriptions share memory when spans don't overlap
+//  - mip chains are built only before a pass samples them with mips, and
+//    only if the texture was written since the last build. Imported targets
+//    remember this across frames, as long as their textures stay the same.
+//  - textures are bound to the declared units, skipping units that already
+//    hold them. Passes may bind anything, so every unit is forgotten after one.
+// Each pass runs inside a profiler zone of the same name.
+class RenderGraph
+{
+public:
+    typedef int Resource;
+    enum { DEPTH = -1 };    // Attachment index of the depth texture
+
+    // Handed to the setup callback of a pass to declare what it uses
+    class Builder
+    {
+    public:
+        // Bind an attachment of resource to a texture unit while the pass runs.
+        // With mips the chain is rebuilt first if the texture changed since.
+        void sample(Resource resource, GLuint unit, int attachment=0, bool mips=false);
+        // Depend on resource without binding it, for passes that bind it themselves
+        void read(Resource resource, int attachment=0);
+        // Render into resource, a pass has at most one target
+        void write(Resource resource);
+        // Keep the pass even if nothing reads its output
+        void sideEffect();
+    private:
+        friend class RenderGraph;
+        Builder(RenderGraph& graph, int pass) : graph(graph), pass(pass) { }
+        RenderGraph& graph;
+        int pass;
+    };
+
+    typedef std::function<void(Builder&)> Setup;
+    typedef std::function<void()> Execute;
+
+    RenderGraph(unsigned maxIdleFrames=120) : frame(0), maxIdleFrames(maxIdleFrames) { }
+    ~RenderGraph() { release(); }
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+
+    // Target that only lives for this frame
+    Resource create(const char* name, const RenderTarget::Desc& desc);
+
+    // Target owned elsewhere. Passes writing an output are never dropped,
+    // use it for the screen and anything kept across frames.
+    Resource import(const char* name, RenderTarget& target, bool output=false);
+
+    // For imported targets rendered to outside the graph, their mips are
+    // rebuilt the next time a pass samples them with mips
+    void markWritten(RenderTarget& target);
+
+    // Setup runs immediately, execute runs later in declaration order with
+    // the written target bound and the viewport set to its size
+    void addPass(const char* name, Setup setup, Execute execute);
+
+    // Blit from src to dst as a pass, dropped like any other
+    void addBlit(const char* name, Resource src, Resource dst, GLbitfield mask=GL_COLOR_BUFFER_BIT);
+
+    // Compiles and runs the declared passes, then clears them for the next frame
+    void execute();
+
+    // Physical target behind a resource, valid while the passes execute
+    RenderTarget& getTarget(Resource resource);
+
+    // Prints the passes of the last frame, dropped ones included
+    void print() const;
+
+    // Releases every transient target
+    void release();
+private:
+    struct Read
+    {
+        Resource resource;
+        int attachment;
+        int unit;       // -1 to leave unbound
+        bool mips;
+    };
+
+    struct Pass
+    {
+        const char* name;
+        Execute execute;
+        std::vector<Read> reads;
+        Resource write;
+        bool sideEffect;
+        bool alive;
+        bool blit;
+        GLbitfield mask;
+    };
+
+    struct Entry
+    {
+        const char* name;
+        RenderTarget::Desc desc;
+        RenderTarget* imported;
+        bool output;
+        int physical;       // Index into physical for transients
+        int first;          // First and last live pass using it
+        int last;
+        unsigned dirtyMips; // Bit per color attachment written since its mips were built
+    };
+
+    // Dirty mip bits of an imported target, kept between frames
+    struct MipState
+    {
+        GLuint texture;     // First color texture, a different one means new contents
+        unsigned dirtyMips;
+    };
+
+    struct Physical
+    {
+        RenderTarget target;
+        unsigned frame;     // Last frame it was used
+        int busyUntil;      // Last pass of the current occupant this frame
+    };
+
+    void compile();
+    void bind(GLuint unit, GLuint texture);
+    GLuint getTexture(const Entry& entry, int attachment);
+
+    std::vector<Pass> passes;
+    std::vector<Entry> entries;
+    std::vector<Physical> physical;
+    std::map<const RenderTarget*, MipState> importedMips;
+    std::vector<GLuint> bound;      // Texture bound per unit this frame, UNKNOWN if not tracked
+    unsigned frame;
+    unsigned maxIdleFrames;
+
+    struct Report { const char* name; bool alive; };
+    std::vector<Report> lastFrame;
+};
+
+#endif // RenderGraph_HPP
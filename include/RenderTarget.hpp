@@ -7,24 +7,99 @@
 class RenderTarget
 {
 public:
-    static RenderTarget create(GLuint width, GLuint height, int num=1, bool hasDepth=true);
+    // Describes the attachments of a target. Formats are GL internal formats,
+    // e.g. GL_R11F_G11F_B10F, GL_RGBA16F, GL_R32F, GL_DEPTH24_STENCIL8 or GL_DEPTH_COMPONENT32F
+    struct Desc
+    {
+        GLuint width = 0;
+        GLuint height = 0;
+        std::vector<GLenum> color = {GL_RGB8};  // One texture per color attachment
+        int levels = 0;                         // Color mip levels, 0 for a full chain
+        GLenum depth = GL_DEPTH_COMPONENT32F;   // GL_NONE for no depth attachment
+        bool depthRenderbuffer = false;         // Write-only depth that can't be sampled
+        int samples = 0;                        // MSAA samples, multisampled targets have no mips
+
+        bool operator==(const Desc& other) const;
+    };
+
+    static RenderTarget create(const Desc& desc);
+    // Color attachments have a full mip chain in the given internal format
+    static RenderTarget create(GLuint width, GLuint height, int num=1, bool hasDepth=true, GLenum format=GL_RGB8);
     RenderTarget() : handle(0), depth(0) { }
     RenderTarget(RenderTarget&& rt);
     RenderTarget& operator=(RenderTarget&& rt);
     ~RenderTarget() { release(); }
     
     void clear();
-    void blit(const RenderTarget& src, int width, int height);
+    // Copies src into the width x height corner of this target, scaling from the
+    // size of src when it has one. Depth copies need matching formats, and
+    // resolving a multisampled src needs matching sizes.
+    void blit(const RenderTarget& src, int width, int height, GLbitfield mask=GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     void activate() const;
+    // Binds for reading from a color attachment, or the back buffer of the screen
+    void bindRead(int attachment=0) const;
+    // Attaches the given mip level of every color texture and sets the viewport to its size
+    void setLevel(int level);
     void release();
 
     size_t getNumTextures() { return textures.size(); }
     GLuint getTexture(int index) { return textures[index]; }
-    GLuint getDepthTexture() { return depth; };
+    // 0 when depth is a renderbuffer
+    GLuint getDepthTexture() { return desc.depthRenderbuffer ? 0 : depth; };
+    const Desc& getDesc() const { return desc; }
+    GLuint getWidth() const { return desc.width; }
+    GLuint getHeight() const { return desc.height; }
+    bool hasDepth() const { return depth != 0; }
+    int getNum() const { return textures.size(); }
+    GLenum getFormat() const { return desc.color.empty() ? GL_NONE : desc.color[0]; }
+    int getLevels() const { return desc.levels; }
+    // False once released or moved from
+    bool isValid() const { return handle != 0 && textures.size() == desc.color.size(); }
+
+    // Fills in the mip count and drops options that don't apply, targets
+    // with equal resolved descriptions are interchangeable
+    static Desc resolve(Desc desc);
 private:
+
     GLuint handle;
     std::vector<GLuint> textures; // Color attachments
-    GLuint depth;  // Renderbuffer attachment
+    GLuint depth;  // Depth texture or renderbuffer attachment
+    Desc desc;     // Resolved description
+};
+
+// Keeps released targets around so they can be handed out again instead of
+// allocating new textures. A recycled target is fenced and only reused once
+// the GPU has finished the commands that were still using it.
+class RenderTargetPool
+{
+public:
+    RenderTargetPool(unsigned maxIdleFrames=120) : frame(0), maxIdleFrames(maxIdleFrames) { }
+    ~RenderTargetPool() { clear(); }
+
+    // Returns a free pooled target with the same description, or creates one
+    RenderTarget acquire(const RenderTarget::Desc& desc);
+
+    // Returns a target to the pool, call after the last draw that uses it
+    void recycle(RenderTarget&& target);
+
+    // Advances the frame counter and releases targets idle for maxIdleFrames
+    void update();
+
+    // Releases every pooled target
+    void clear();
+
+    size_t size() const { return entries.size(); }
+private:
+    struct Entry
+    {
+        RenderTarget target;
+        GLsync fence;
+        unsigned frame;     // Frame it was recycled on
+    };
+
+    std::vector<Entry> entries;
+    unsigned frame;
+    unsigned maxIdleFrames;
 };
 
 #endif
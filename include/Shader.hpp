@@ -35,6 +35,9 @@ private:
 };
 
 GLuint loadShader(const char* filename, GLenum type);
+// Pastes the includes in after the #version line of filename, for sources
+// shared with programs they can't be linked into, e.g. compute shaders
+GLuint loadShader(const char* filename, GLenum type, const std::list<const char*>& includes);
 GLuint createShader(const char* source, GLenum type);
 
 Shader createProgram(const std::list<GLuint>& shaders);
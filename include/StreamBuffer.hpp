@@ -0,0 +1,83 @@
+#ifndef StreamBuffer_HPP
+#define StreamBuffer_HPP
+
+#include "Graphics.hpp"
+#include "Buffer.hpp"
+#include "Mesh.hpp"
+#include <deque>
+#include <vector>
+
+namespace Graphics {
+
+// Ring allocator over one large buffer for geometry that changes every frame.
+// The buffer is mapped once and written directly, each frame's allocations
+// are fenced and only reused once the GPU is done reading them, so streaming
+// never calls glBufferData or waits unless the ring is full. Without
+// ARB_buffer_storage writes go to a shadow copy uploaded by flush().
+class StreamBuffer
+{
+public:
+    struct Range
+    {
+        GLintptr offset;    // In bytes from the start of the buffer
+        GLsizeiptr size;
+        void* data;         // Write only, valid until the range is fenced and reused
+    };
+
+    StreamBuffer() : buffer(0), mapped(nullptr), capacity(0), head(0), used(0), frameBytes(0) { }
+    ~StreamBuffer() { release(); }
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    // Allocates and maps size bytes, requires a current context. A frame
+    // can use at most size bytes, a few frames' worth avoids waiting.
+    void initialize(size_t size);
+
+    // Reserves size bytes at a multiple of alignment, waiting on old frames if
+    // the ring is full. Alignment need not be a power of two, e.g. a vertex size.
+    Range allocate(size_t size, size_t alignment=4);
+
+    // Uploads ranges written since the last flush, call before drawing from
+    // them. Nothing to do when the buffer is persistently mapped.
+    void flush();
+
+    // Fences everything allocated this frame
+    void endFrame();
+
+    // Surface drawing vertices of the given layout from the ring, with no
+    // geometry until it is streamed. The vertex array belongs to the stream
+    // buffer, don't deleteSurface it.
+    Surface createSurface(const std::vector<Attrib>& attributes, size_t stride);
+
+    // Copies this frame's geometry of surface into the ring
+    void stream(Surface& surface, const Buffer& vertices);
+    void stream(Surface& surface, const Buffer& vertices, const std::vector<GLuint>& indices);
+
+    bool isPersistent() const { return shadow.empty(); }
+    GLuint getBuffer() const { return buffer; }
+
+    void release();
+private:
+    struct Fence
+    {
+        GLsync sync;
+        size_t bytes;       // Ring space freed once the fence signals
+    };
+
+    bool waitOldest();
+
+    GLuint buffer;
+    unsigned char* mapped;  // Persistent mapping, or the shadow copy
+    std::vector<unsigned char> shadow;
+    std::vector<Range> dirty;   // Shadow ranges not uploaded yet
+    std::vector<GLuint> layouts;// Vertex arrays of created surfaces
+    std::deque<Fence> fences;
+    size_t capacity;
+    size_t head;            // Next free byte
+    size_t used;            // Bytes from the oldest unfinished frame to head, including padding
+    size_t frameBytes;      // Of those, allocated this frame
+};
+
+} // Graphics
+
+#endif // StreamBuffer_HPP
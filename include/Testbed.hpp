@@ -5,11 +5,49 @@
 
 namespace Testbed {
 
+// Swap interval, adaptive syncs to vblank but tears instead of waiting when late
+enum VSync { VSYNC_OFF = 0, VSYNC_ON = 1, VSYNC_ADAPTIVE = -1 };
+
+// Options controlling how the context and framebuffer are created
+struct Options
+{
+    int width = 1600;               // Framebuffer width
+    int height = 900;               // Framebuffer height
+    bool headless = false;          // Use an offscreen EGL pbuffer instead of a window
+    int frames = 0;                 // Stop after this many frames, 0 runs until stopped
+    const char* report = nullptr;   // Frame statistics output file (.csv or .json)
+    const char* record = nullptr;   // Camera path file to record to
+    const char* replay = nullptr;   // Camera path file to replay with a fixed timestep
+    double dt = 1.0 / 60.0;         // Timestep used while replaying
+    const char* benchmark = nullptr;// Report per replay segment or golden pose
+    bool threaded = false;          // Simulate the next frame on a worker thread
+    VSync vsync = VSYNC_OFF;        // Swap interval mode
+    double fpsLimit = 0.0;          // Frame rate cap, 0 is uncapped
+    int framesInFlight = 0;         // Frames the CPU may run ahead of the GPU, 0 leaves it to the driver
+    const char* capture = nullptr;  // Writes every frame to this printf pattern, e.g. frames/%05d.png
+    const char* golden = nullptr;   // Directory with poses.txt and the reference images to compare against
+    bool updateGolden = false;      // Write the reference images instead of comparing
+    const char* ssr = nullptr;      // Name of the SSR backend, the test's default when unset
+    bool strips = false;            // Draw indexed terrain as restarted triangle strips
+    bool indirect = true;           // Use multi-draw indirect where the context has it
+    bool arena = true;              // Batch scenery in a geometry arena, otherwise one instanced draw per shape
+};
+
 // Quits safely if condition is false
 void assert(bool condition, const char* msg);
 
+// Parses --headless, --size WxH, --frames N, --report file, --record file,
+// --replay file, --dt seconds, --benchmark file, --threaded, --vsync off|on|adaptive,
+// --fps N, --frames-in-flight N, --capture pattern, --golden dir,
+// --update-golden, --ssr backend, --strips, --no-indirect and --no-arena
+// from the command line
+Options parseOptions(int argc, char* argv[]);
+
 // Initializes the testbed application
-void initialize();
+void initialize(const Options& options = Options());
+
+// Returns the options passed to initialize
+const Options& getOptions();
 
 // Releases resources and terminates the application
 void shutdown();
@@ -23,6 +61,23 @@ void stop();
 // Process events and show the rendered frame
 void update();
 
+// Frame pacing, applied by update() around the buffer swap. Adaptive falls
+// back to on when the driver lacks swap_control_tear.
+void setVSync(VSync mode);
+VSync getVSync();
+
+// Caps the frame rate by sleeping then spinning until the next deadline, 0 disables
+void setFrameLimit(double fps);
+double getFrameLimit();
+
+// Waits on a fence so at most this many frames are queued on the GPU. Lower
+// values cut input latency at the cost of CPU/GPU overlap, 0 disables.
+void setMaxFramesInFlight(int frames);
+int getMaxFramesInFlight();
+
+// Returns true if rendering to an offscreen surface with no window
+bool isHeadless();
+
 // Returns the time since program initialization in seconds
 double getTime();
 
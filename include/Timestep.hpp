@@ -0,0 +1,39 @@
+#ifndef Timestep_HPP
+#define Timestep_HPP
+
+namespace Testbed {
+
+// Splits variable frame times into fixed simulation ticks. Leftover time
+// carries over to the next frame and is exposed as an interpolation factor
+// so rendering can blend between the last two simulated states.
+class FixedTimestep
+{
+public:
+    FixedTimestep(double tick=1.0/120.0, int maxSteps=8);
+
+    // Adds a frame's time and returns the number of ticks to simulate. At
+    // most maxSteps are returned, the rest of a long frame is dropped so a
+    // slow frame cannot cause an ever growing backlog of ticks.
+    int advance(double dt);
+
+    // Fraction of a tick elapsed since the last simulated state, in [0, 1)
+    float getAlpha() const { return float(accumulator / tick); }
+
+    double getTick() const { return tick; }
+    void setTick(double seconds) { tick = seconds; }
+    void setMaxSteps(int steps) { maxSteps = steps; }
+
+    // Total simulated time and time dropped by the catch-up cap
+    double getTime() const { return time; }
+    double getDroppedTime() const { return dropped; }
+private:
+    double tick;
+    int maxSteps;
+    double accumulator;
+    double time;
+    double dropped;
+};
+
+} // Testbed
+
+#endif // Timestep_HPP
@@ -0,0 +1,164 @@
+#ifndef VertexFormat_HPP
+#define VertexFormat_HPP
+
+#include "Graphics.hpp"
+#include "Mesh.hpp"
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// Vertex layouts derived from the members of the vertex struct, so they can't
+// drift from it, e.g. vertexFormat(&Vertex::position, &Vertex::color). The
+// GL type of each member comes from AttribFormat at compile time, which also
+// covers packed types that take a half to a quarter of the space of floats.
+
+namespace Graphics
+{
+
+// Packed attribute types, the shader still sees floats
+struct Half2 { uint16_t x, y; };
+struct Half4 { uint16_t x, y, z, w; };
+
+// N integers read as [0, 1] when T is unsigned and [-1, 1] when signed
+template <class T, int N>
+struct Norm { T v[N]; };
+
+typedef Norm<uint8_t, 4> UByte4N;   // Colors
+typedef Norm<int8_t, 4> Byte4N;     // Normals and tangents
+typedef Norm<uint16_t, 2> UShort2N; // Texture coordinates
+typedef Norm<int16_t, 2> Short2N;
+typedef Norm<int16_t, 4> Short4N;
+
+// Signed normalized xyz in 10 bits each and w in 2, for normals
+struct Int1010102N { uint32_t bits; };
+
+//============================================================================//
+// Compile time attribute formats                                             //
+//============================================================================//
+
+template <GLint Size, GLenum Type, GLboolean Normalized>
+struct AttribInfo
+{
+    static constexpr GLint size = Size;
+    static constexpr GLenum type = Type;
+    static constexpr GLboolean normalized = Normalized;
+};
+
+// Unsupported member types fail to compile here
+template <class T> struct AttribFormat;
+
+template <> struct AttribFormat<float> : AttribInfo<1, GL_FLOAT, GL_FALSE> { };
+template <> struct AttribFormat<glm::vec2> : AttribInfo<2, GL_FLOAT, GL_FALSE> { };
+template <> struct AttribFormat<glm::vec3> : AttribInfo<3, GL_FLOAT, GL_FALSE> { };
+template <> struct AttribFormat<glm::vec4> : AttribInfo<4, GL_FLOAT, GL_FALSE> { };
+template <> struct AttribFormat<Half2> : AttribInfo<2, GL_HALF_FLOAT, GL_FALSE> { };
+template <> struct AttribFormat<Half4> : AttribInfo<4, GL_HALF_FLOAT, GL_FALSE> { };
+template <> struct AttribFormat<Int1010102N> : AttribInfo<4, GL_INT_2_10_10_10_REV, GL_TRUE> { };
+
+template <class T> struct GLType;
+template <> struct GLType<int8_t> { static constexpr GLenum value = GL_BYTE; };
+template <> struct GLType<uint8_t> { static constexpr GLenum value = GL_UNSIGNED_BYTE; };
+template <> struct GLType<int16_t> { static constexpr GLenum value = GL_SHORT; };
+template <> struct GLType<uint16_t> { static constexpr GLenum value = GL_UNSIGNED_SHORT; };
+
+template <class T, int N>
+struct AttribFormat<Norm<T, N>> : AttribInfo<N, GLType<T>::value, GL_TRUE>
+{
+    static_assert(N >= 1 && N <= 4, "Attributes have 1 to 4 components");
+};
+
+// Byte offset of member in Vertex
+template <class Vertex, class T>
+GLuint offsetOf(T Vertex::*member)
+{
+    static const Vertex sample = Vertex();
+    return GLuint(reinterpret_cast<const char*>(&(sample.*member)) - reinterpret_cast<const char*>(&sample));
+}
+
+template <class Vertex, class T>
+Attrib attribOf(T Vertex::*member)
+{
+    typedef AttribFormat<T> Format;
+    return {GLuint(Format::size), Format::type, Format::normalized, offsetOf(member), GL_TRUE};
+}
+
+// Layout of Vertex, one attribute per member in shader location order
+template <class Vertex, class T, class... Rest>
+std::vector<Attrib> vertexFormat(T Vertex::*first, Rest Vertex::*... rest)
+{
+    return {attribOf(first), attribOf(rest)...};
+}
+
+// Layout of a vertex that is a single attribute, e.g. vertexFormat<glm::vec2>()
+template <class Vertex>
+std::vector<Attrib> vertexFormat()
+{
+    typedef AttribFormat<Vertex> Format;
+    return {{GLuint(Format::size), Format::type, Format::normalized, 0, GL_TRUE}};
+}
+
+//============================================================================//
+// Packing                                                                    //
+//============================================================================//
+
+// Round to nearest half, out of range values become infinity
+uint16_t packHalf(float value);
+float unpackHalf(uint16_t value);
+
+// Clamps to the normalized range of T and rounds
+template <class T>
+T packNorm(float value)
+{
+    const float max = float((1u << (8 * sizeof(T) - (T(-1) < T(0) ? 1 : 0))) - 1);
+    const float min = T(-1) < T(0) ? -1.0f : 0.0f;
+    value = value < min ? min : value > 1.0f ? 1.0f : value;
+    return T(value * max + (value < 0.0f ? -0.5f : 0.5f));
+}
+
+// Overloads for filling packed members from float vectors, missing components are 0
+void pack(Half2& out, const glm::vec2& in);
+void pack(Half4& out, const glm::vec4& in);
+void pack(Int1010102N& out, const glm::vec3& in, int w=0);
+
+template <class T, int N, class V>
+void pack(Norm<T, N>& out, const V& in)
+{
+    const int components = sizeof(V) / sizeof(float);
+    for (int i = 0; i < N; i++)
+        out.v[i] = packNorm<T>(i < components ? in[i] : 0.0f);
+}
+
+// Unpacked members copy through
+template <class T>
+void pack(T& out, const T& in) { out = in; }
+
+template <class Packed, class Vertex, class Convert>
+std::vector<Packed> quantizeVertices(const std::vector<Vertex>& vertices, Convert convert)
+{
+    std::vector<Packed> packed;
+    packed.reserve(vertices.size());
+    for (const Vertex& vertex : vertices)
+        packed.push_back(convert(vertex));
+    printf("[Mesh] Quantized %zu vertices from %zu to %zu bytes each\n",
+           vertices.size(), sizeof(Vertex), sizeof(Packed));
+    return packed;
+}
+
+// Converts every vertex with convert, a function from Vertex to Packed, and
+// describes the result with format
+template <class Packed, class Vertex, class Convert>
+Mesh<Packed> quantize(const Mesh<Vertex>& mesh, const std::vector<Attrib>& format, Convert convert)
+{
+    return {format, quantizeVertices<Packed>(mesh.vertices, convert)};
+}
+
+template <class Packed, class Vertex, class Convert>
+IndexedMesh<Packed> quantize(const IndexedMesh<Vertex>& mesh, const std::vector<Attrib>& format, Convert convert)
+{
+    return {format, quantizeVertices<Packed>(mesh.vertices, convert), mesh.indices, mesh.strip};
+}
+
+}
+
+#endif // VertexFormat_HPP
@@ -0,0 +1,54 @@
+#version 330 core
+
+// G-buffer packing shared by every program that writes or reads it. Linked
+// in as a separate shader object, callers declare the prototypes they use.
+// ssr_tiled.comp has it pasted in at load instead.
+// Layout of the RGBA16F attachment:
+//  xy  normal, octahedral encoded
+//  z   roughness, slope variance as used by LEAN
+//  w   linear depth, 0 where nothing was drawn
+
+uniform mat4 invMvp;    // Only needed for reconstructing positions
+
+const float near = 0.1;
+const float far = 100.0;
+
+float linearZ(float z) {
+  return (2 * near * far) / (far + near - z * (far - near));
+}
+
+vec2 wrapOctahedron(vec2 v) {
+  return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Unit normal to [-1, 1]^2, the lower hemisphere folds over the diagonals
+vec2 encodeNormal(vec3 N) {
+  N /= abs(N.x) + abs(N.y) + abs(N.z);
+  return N.y >= 0.0 ? N.xz : wrapOctahedron(N.xz);
+}
+
+vec3 decodeNormal(vec2 e) {
+  vec3 N = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+  if (N.y < 0.0) N.xz = wrapOctahedron(N.xz);
+  return normalize(N);
+}
+
+vec4 packGBuffer(vec3 N, float roughness, float z) {
+  return vec4(encodeNormal(N), roughness, linearZ(z));
+}
+
+// Slope variance of a Blinn-Phong lobe with the given exponent
+float phongRoughness(float shininess) {
+  return 2.0 / (shininess + 2.0);
+}
+
+// Window z from the linear depth stored in the G-buffer, inverse of linearZ
+float windowZ(float linear) {
+  return (far + near - 2 * near * far / linear) / (far - near);
+}
+
+// World space position of the pixel at uv with the stored linear depth
+vec3 worldPosition(vec2 uv, float linear) {
+  vec4 P = invMvp * vec4(vec3(uv, windowZ(linear)) * 2.0 - 1.0, 1.0);
+  return P.xyz / P.w;
+}
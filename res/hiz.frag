@@ -0,0 +1,41 @@
+#version 330 core
+
+// Builds one level of the min-depth pyramid. source is either the depth
+// buffer or the previous level, restricted so that lod 0 is that level.
+
+uniform sampler2D source;
+uniform bool copy = false;
+
+out float depth;
+
+void main()
+{
+  ivec2 dst = ivec2(gl_FragCoord.xy);
+  if (copy) {
+    depth = texelFetch(source, dst, 0).x;
+    return;
+  }
+
+  ivec2 size = textureSize(source, 0);
+  ivec2 src = dst * 2;
+  ivec2 last = size - 1;
+  float d = texelFetch(source, min(src, last), 0).x;
+  d = min(d, texelFetch(source, min(src + ivec2(1, 0), last), 0).x);
+  d = min(d, texelFetch(source, min(src + ivec2(0, 1), last), 0).x);
+  d = min(d, texelFetch(source, min(src + ivec2(1, 1), last), 0).x);
+
+  // Odd sizes leave a row or column that would otherwise be skipped
+  bool oddX = (size.x & 1) != 0 && src.x + 2 == last.x;
+  bool oddY = (size.y & 1) != 0 && src.y + 2 == last.y;
+  if (oddX) {
+    d = min(d, texelFetch(source, ivec2(src.x + 2, src.y), 0).x);
+    d = min(d, texelFetch(source, min(ivec2(src.x + 2, src.y + 1), last), 0).x);
+  }
+  if (oddY) {
+    d = min(d, texelFetch(source, ivec2(src.x, src.y + 2), 0).x);
+    d = min(d, texelFetch(source, min(ivec2(src.x + 1, src.y + 2), last), 0).x);
+  }
+  if (oddX && oddY)
+    d = min(d, texelFetch(source, src + 2, 0).x);
+  depth = d;
+}
@@ -0,0 +1,49 @@
+#version 330 core
+
+// Hi-Z ray march shared by ssr.frag and ssr_tiled.comp. Not a shader of its
+// own, Graphics::loadShader pastes it in after the #version line of both.
+
+uniform sampler2D hiz;          // Min-depth pyramid of depth
+uniform int hizLevels = 1;
+const int maxHiZSteps = 64;
+
+// March pos along dir through the min-depth pyramid. dir moves one pixel per
+// unit t along its major axis, size is the pixel size of the pyramid's base
+// and the march starts at tStart. Cells the ray passes in front of are skipped
+// whole and the ray climbs a level, when it might pass behind the nearest
+// depth in a cell it drops a level, and at level 0 that is a hit.
+bool traceHiZ(inout vec3 pos, vec3 dir, vec2 size, float tStart, int steps, float tMax, out float t) {
+  vec3 origin = pos;
+  vec2 dirPx = dir.xy * size;
+  // Avoid dividing by zero for axis aligned rays
+  dirPx = sign(dirPx) * max(abs(dirPx), vec2(1e-5)) + vec2(equal(dirPx, vec2(0))) * 1e-5;
+  int level = 0;
+  t = tStart;
+  for (int i = 0; i < steps; i++) {
+    pos = origin + dir * t;
+    if (pos.x >= 1 || pos.x < 0 || pos.y >= 1 || pos.y < 0 || t > tMax) return false;
+
+    float cellSize = exp2(float(level));
+    vec2 cell = floor(pos.xy * size / cellSize);
+    ivec2 texel = min(ivec2(cell), textureSize(hiz, level) - 1);
+    float zmin = texelFetch(hiz, texel, level).x;
+
+    // Distance to the edge of the cell the ray is heading for
+    vec2 boundary = (cell + step(0.0, dirPx)) * cellSize;
+    vec2 tCell = (boundary - pos.xy * size) / dirPx;
+    float tExit = t + min(tCell.x, tCell.y) + 0.01;
+    float zFar = max(pos.z, origin.z + dir.z * tExit);
+
+    if (zFar < zmin) {
+      t = tExit;
+      level = min(level + 1, hizLevels - 1);
+    } else if (level == 0) {
+      return true;
+    } else {
+      // Move up to where the ray reaches the nearest depth, then refine
+      if (dir.z > 0) t = max(t, (zmin - origin.z) / dir.z);
+      level--;
+    }
+  }
+  return false;
+}
@@ -15,6 +15,8 @@ layout(std140) uniform WorldData {
     vec3 eye;
     float time;
     vec2 dimensions;
+    float frame;        // Frame counter, wraps
+    mat4 prevMvp;       // Last frame's mvp, for reprojection
 };
 
 void main()
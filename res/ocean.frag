@@ -7,20 +7,41 @@ in VSOutput
     vec4 uv;    // Texture coordinates for each layer
 } FSinput;
 
-out vec3 color;
+layout(location = 0) out vec3 color;
+// Only written when tracing at reduced resolution
+layout(location = 1) out vec3 refraction;
+layout(location = 2) out vec4 surface;     // Linear depth and normal xz for the upsample, G-buffer when deferred
+layout(location = 3) out vec2 motion;      // Offset to last frame's uv for the temporal resolve
 
 uniform sampler2D gradient;
 uniform sampler2D covariance;
 uniform sampler2D backBuffer;
 uniform sampler2D depth;
+
+// Full resolution traces in place. Otherwise a reduced resolution pass
+// traces into a target, and the full resolution pass upsamples it.
+// Deferred mode first writes the water into the G-buffer, the full
+// resolution pass then takes its reflection from the shared resolve, and
+// with the tiled compute backend its refraction as well.
+const int SSR_FULL = 0;
+const int SSR_TRACE = 1;
+const int SSR_UPSAMPLE = 2;
+const int SSR_GBUFFER = 3;
+const int SSR_DEFERRED = 4;
+const int SSR_TILED = 5;
+uniform int ssrMode = SSR_FULL;
+uniform sampler2D ssrReflection;
+uniform sampler2D ssrRefraction;
+uniform sampler2D ssrSurface;
 uniform vec3 light;
-uniform bool rough = true;
 
 layout(std140) uniform WorldData {
     mat4 mvp;
     vec3 eye;
     float time;
     vec2 dimensions;
+    float frame;        // Frame counter, wraps
+    mat4 prevMvp;       // Last frame's mvp, for reprojection
 };
 
 const vec3 waterColor = vec3(57, 88, 121) / 255.0;
@@ -28,16 +49,13 @@ const float Ka = 0.2;
 const float Kd = 0.4;
 const float Ks = 0.4;
 const float shininess = 64.0;
-const float near = 0.1;
-const float far = 100.0;
 const float density = 1.0f;
-const float stride = 1.0f;
-
 
-float linearZ(float z) {
-  float zn = 2.0 * z - 1.0;
-  return (2 * near * far) / (far + near - z * (far - near));
-}
+// ssr.frag
+vec4 traceSS(vec3 P, vec3 dP, vec2 covar);
+// gbuffer.frag
+float linearZ(float z);
+vec4 packGBuffer(vec3 N, float roughness, float z);
 
 // Samples and combines the two LEAN maps
 void sampleLEAN(vec2 uv1, vec2 uv2, out vec2 G, out vec3 C) {
@@ -54,86 +72,63 @@ void sampleLEAN(vec2 uv1, vec2 uv2, out vec2 G, out vec3 C) {
 
 
 
-// Trace in screen space, if no intersection occurs, return background
-vec3 traceSS(vec3 P, vec3 dP, vec3 background, vec2 covar) {
-//  if (dP.y <= 0) return background;
-
-  // Find starting position in screen space
-  vec4 pixel = mvp * vec4(P, 1);
-  vec3 pos = pixel.xyz / pixel.w;
-  pos += 1;
-  pos /= 2;
-
-  // Project the ray onto the surface that is the furthest possible reflection
-  if (dP.y < 0) dP *= 2.0 / -dP.y;
-  if (dP.y > 0) dP *= 4.0 / dP.y;
-//  if (dP.x > 20 || dP.x < -20) dP *= 20.0f / abs(dP.x); // clamp on x axis
-//  if (dP.z > 20 || dP.z < -20) dP *= 20.0f / abs(dP.z); // clamp on z axis
-
-  // Find another position along ray in screen space
-  pixel = mvp * vec4(P + dP, 1);
-  vec3 p2 = pixel.xyz / pixel.w;
-  if (pixel.w < 0) return background;
-  p2 += 1;
-  p2 /= 2;
-
-  // Calculate direction along ray
-  vec3 dir = p2 - pos;
-  dir.xy *= dimensions;
-  float iterations = max(abs(dir.x), abs(dir.y));
-  dir /= iterations;
-  dir.xy /= dimensions;
-  dir *= stride;
-  iterations /= stride;
-
-  float blur = 128 * sqrt(covar.x + covar.y);
-  
-  vec2 dPdx = blur * dir.xy;
-  vec2 dPdy = blur * vec2(dir.y, -dir.x);
-  float step = 1;
- 
-  float diff = 0;
-  if (iterations > dimensions.y) iterations = dimensions.y;
-  float intersect = 0.0f;
-  for (float i = 0; i < iterations; i += step) {
-    pos += dir * step;
-    float depth = texture(depth, pos.xy).x;
-    if (pos.x >= 1 || pos.x < 0 || pos.y >= 1 || pos.y < 0) break;
-    diff = abs(depth - pos.z);
-    if (depth < pos.z) {
-      intersect = 1.0f;
-      break;
-    }
-    step *= 1.05;
+// Joint bilateral upsample of the reduced resolution traces. Each of the
+// four nearest low resolution texels is weighted by its bilinear weight and
+// by how closely its depth and normal match this pixel, so reflections do
+// not bleed across silhouettes or wave crests.
+void upsampleSSR(vec2 uv, float z, vec3 N, out vec3 reflected, out vec3 refracted) {
+  ivec2 size = textureSize(ssrReflection, 0);
+  vec2 st = uv * vec2(size) - 0.5;
+  ivec2 base = ivec2(floor(st));
+  vec2 f = fract(st);
+
+  reflected = vec3(0);
+  refracted = vec3(0);
+  float total = 0.0;
+  for (int i = 0; i < 4; i++) {
+    ivec2 offset = ivec2(i & 1, i >> 1);
+    ivec2 texel = clamp(base + offset, ivec2(0), size - 1);
+    vec4 s = texelFetch(ssrSurface, texel, 0);
+    vec3 n = vec3(s.y, sqrt(max(1.0 - s.y*s.y - s.z*s.z, 0.0)), s.z);
+
+    vec2 b = mix(1.0 - f, f, vec2(offset));
+    float w = b.x * b.y;
+    w *= s.w * exp(-abs(s.x - z) / (0.02 * z));
+    w *= pow(max(dot(n, N), 0.0), 16.0);
+    // Keep a little plain bilinear so isolated pixels still get something
+    w += 1e-4 * b.x * b.y;
+
+    reflected += w * texelFetch(ssrReflection, texel, 0).rgb;
+    refracted += w * texelFetch(ssrRefraction, texel, 0).rgb;
+    total += w;
   }
-  if (diff > 0.005) intersect = 0.0f;
-  vec3 back;
-  if (rough)
-    back = textureGrad(backBuffer, pos.xy, dPdx*step, dPdy*step).xyz;
-  else
-    back = texture(backBuffer, pos.xy).xyz;
-//  vec3 back = textureLod(backBuffer, pos.xy, 10).xyz;
-  
-  float edge = 1.0 - max(max(pos.x, 1.0-pos.x), max(pos.y, 1.0-pos.y));
-  edge = clamp(edge * 16, 0, 1);
-
-  return mix(background, back, intersect * log2(edge+1));
+  reflected /= total;
+  refracted /= total;
 }
 
 void main()
 {
+    vec2 G; vec3 C;
+    sampleLEAN(FSinput.uv.xy, FSinput.uv.zw, G, C);
+    vec3 N = normalize(vec3(G.x, 1, G.y));
+    if (ssrMode == SSR_GBUFFER) {
+      // Depth tested against the attached scene depth, nothing else is written
+      surface = packGBuffer(N, C.x + C.y, gl_FragCoord.z);
+      return;
+    }
+
     vec3 pixel = FSinput.posSS.xyz / FSinput.posSS.w;
     pixel += 1;
     pixel /= 2;
-    float depth = linearZ(texture(depth, pixel.xy).x);
+
+    // The scene depth is sampled rather than attached, so depth test here
+    float sceneDepth = textureLod(depth, pixel.xy, 0).x;
+    if (sceneDepth < gl_FragCoord.z) discard;
+    float depth = linearZ(sceneDepth);
     depth -= linearZ(pixel.z);
     float fog = exp(-depth * density);
     vec3 refracted = texture(backBuffer, pixel.xy).rgb;
-    
-    vec2 G; vec3 C;
-    sampleLEAN(FSinput.uv.xy, FSinput.uv.zw, G, C);
 
-    vec3 N = normalize(vec3(G.x, 1, G.y));
     vec3 L = normalize(light - FSinput.posWS);
     vec3 V = normalize(eye - FSinput.posWS);
     vec3 H = normalize(L + V);
@@ -147,9 +142,31 @@ void main()
    
     float fresnel = 0.05 + (1-0.05)*pow(1-dot(V, N), 5);
     
-    refracted = traceSS(FSinput.posWS, refract(-V, N, 1/1.33f), refracted, vec2(0));
+    vec3 reflected;
+    vec3 sky = vec3(spec) + vec3(0, 191.0f/255.0f, 1);
+    if (ssrMode == SSR_UPSAMPLE) {
+      upsampleSSR(pixel.xy, linearZ(pixel.z), N, reflected, refracted);
+    } else if (ssrMode == SSR_TILED) {
+      vec4 traced = texture(ssrRefraction, pixel.xy);
+      refracted = mix(refracted, traced.rgb, traced.a);
+      traced = texture(ssrReflection, pixel.xy);
+      reflected = mix(sky, traced.rgb, traced.a);
+    } else {
+      vec4 traced = traceSS(FSinput.posWS, refract(-V, N, 1/1.33f), vec2(0));
+      refracted = mix(refracted, traced.rgb, traced.a);
+      traced = ssrMode == SSR_DEFERRED ? texture(ssrReflection, pixel.xy) : traceSS(FSinput.posWS, reflect(-V, N), C.xy);
+      reflected = mix(sky, traced.rgb, traced.a);
+    }
+    if (ssrMode == SSR_TRACE) {
+      color = reflected;
+      refraction = refracted;
+      surface = vec4(linearZ(pixel.z), N.x, N.z, 1.0);
+      vec4 prev = prevMvp * vec4(FSinput.posWS, 1.0);
+      motion = (prev.xy / prev.w + 1.0) / 2.0 - pixel.xy;
+      return;
+    }
+
     refracted = mix((Ka + diff) * waterColor, refracted, fog);
-    vec3 reflected = traceSS(FSinput.posWS, reflect(-V, N), vec3(spec) + vec3(0, 191.0f/255.0f, 1), C.xy);
     color = mix(refracted, reflected, fresnel);
 //    color = reflected;
 //    color = refracted;
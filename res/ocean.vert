@@ -14,6 +14,8 @@ layout(std140) uniform WorldData {
     vec3 eye;
     float time;
     vec2 dimensions;
+    float frame;        // Frame counter, wraps
+    mat4 prevMvp;       // Last frame's mvp, for reprojection
 };
 
 const vec2 scroll1 = 0.25 * vec2(cos(45), sin(45));
@@ -7,7 +7,8 @@ in VSOutput
     vec3 color;
 } FSinput;
 
-out vec3 color;
+layout(location = 0) out vec3 color;
+layout(location = 1) out vec4 gbuffer;     // Only stored when rendering deferred
 
 uniform vec3 light;
 
@@ -16,6 +17,8 @@ layout (std140) uniform WorldData {
     vec3 eye;
     float time;
     vec2 dimensions;
+    float frame;        // Frame counter, wraps
+    mat4 prevMvp;       // Last frame's mvp, for reprojection
 };
 
 const float Ka = 0.5;
@@ -23,6 +26,10 @@ const float Kd = 0.2;
 const float Ks = 0.0;
 const float shininess = 16.0;
 
+// gbuffer.frag
+vec4 packGBuffer(vec3 N, float roughness, float z);
+float phongRoughness(float shininess);
+
 void main()
 {
     vec3 L = normalize(light - FSinput.position);
@@ -31,4 +38,5 @@ void main()
     float diff = Kd * max(dot(L, FSinput.normal), 0.0);
     float spec = Ks * pow(max(dot(H, FSinput.normal), 0.0), shininess);
     color = (Ka + diff) * FSinput.color + vec3(spec);
+    gbuffer = packGBuffer(normalize(FSinput.normal), phongRoughness(shininess), gl_FragCoord.z);
 }
@@ -0,0 +1,45 @@
+#version 330 core
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+
+// Per instance, the rows of the object to world transform. The translation in
+// their w is relative to the terrain, which lifts each instance onto it.
+layout(location = 2) in vec4 transformX;
+layout(location = 3) in vec4 transformY;
+layout(location = 4) in vec4 transformZ;
+layout(location = 5) in vec4 color;
+layout(location = 6) in float lod;  // 0 up close, shrunk away by 1
+
+uniform sampler2D heightmap;
+
+out VSOutput
+{
+    vec3 position;
+    vec3 normal;
+    vec3 color;
+} FSinput;
+
+layout(std140) uniform WorldData {
+    mat4 mvp;
+    vec3 eye;
+    float time;
+    vec2 dimensions;
+    float frame;        // Frame counter, wraps
+    mat4 prevMvp;       // Last frame's mvp, for reprojection
+};
+
+void main()
+{
+    vec4 local = vec4(position * (1.0 - lod), 1.0);
+    vec3 world = vec3(dot(transformX, local), dot(transformY, local), dot(transformZ, local));
+
+    // Same height as terrain.vert at the instance's origin
+    vec2 uv = vec2(transformX.w, transformZ.w) / 40 + 0.5;
+    world.y += (texture(heightmap, uv).r - .25) * 4;
+
+    FSinput.position = world;
+    FSinput.normal = normalize(vec3(dot(transformX.xyz, normal), dot(transformY.xyz, normal), dot(transformZ.xyz, normal)));
+    FSinput.color = color.rgb;
+    gl_Position = mvp * vec4(world, 1.0);
+}
@@ -0,0 +1,114 @@
+#version 330 core
+
+// Screen space ray tracing against the scene depth, shared by the ocean and
+// the deferred reflection pass. Linked in as a separate shader object and
+// loaded with hiz_trace.glsl.
+
+uniform sampler2D backBuffer;
+uniform sampler2D depth;
+uniform bool hierarchical = true;
+uniform bool rough = true;
+uniform float stride = 1.0f;   // Pixels per linear step, matches the trace resolution
+
+// Temporal traces are cut short and start at a per-pixel jittered offset,
+// the resolve pass averages the noise out over frames
+uniform bool temporal = false;
+const float temporalStride = 4.0;
+const int temporalHiZSteps = 24;
+
+layout(std140) uniform WorldData {
+    mat4 mvp;
+    vec3 eye;
+    float time;
+    vec2 dimensions;
+    float frame;        // Frame counter, wraps
+    mat4 prevMvp;       // Last frame's mvp, for reprojection
+};
+
+// Interleaved gradient noise, shifted every frame
+float jitter() {
+  vec2 p = gl_FragCoord.xy + mod(frame, 64.0) * 5.588238;
+  return fract(52.9829189 * fract(dot(p, vec2(0.06711056, 0.00583715))));
+}
+
+// Trace in screen space, returns the color found and how much to trust it,
+// 0 where there was no intersection
+vec4 traceSS(vec3 P, vec3 dP, vec2 covar) {
+  // Find starting position in screen space
+  vec4 pixel = mvp * vec4(P, 1);
+  vec3 pos = pixel.xyz / pixel.w;
+  pos += 1;
+  pos /= 2;
+
+  // Project the ray onto the surface that is the furthest possible reflection
+  if (dP.y < 0) dP *= 2.0 / -dP.y;
+  if (dP.y > 0) dP *= 4.0 / dP.y;
+//  if (dP.x > 20 || dP.x < -20) dP *= 20.0f / abs(dP.x); // clamp on x axis
+//  if (dP.z > 20 || dP.z < -20) dP *= 20.0f / abs(dP.z); // clamp on z axis
+
+  // Find another position along ray in screen space
+  pixel = mvp * vec4(P + dP, 1);
+  vec3 p2 = pixel.xyz / pixel.w;
+  if (pixel.w < 0) return vec4(0);
+  p2 += 1;
+  p2 /= 2;
+
+  // Calculate direction along ray
+  vec3 dir = p2 - pos;
+  dir.xy *= dimensions;
+  float iterations = max(abs(dir.x), abs(dir.y));
+  dir /= iterations;
+  dir.xy /= dimensions;
+  dir *= stride;
+  iterations /= stride;
+  if (temporal && !hierarchical) {
+    dir *= temporalStride;
+    iterations /= temporalStride;
+    pos += dir * jitter();
+  }
+
+  float blur = 128 * sqrt(covar.x + covar.y);
+  
+  vec2 dPdx = blur * dir.xy;
+  vec2 dPdy = blur * vec2(dir.y, -dir.x);
+  float step = 1;
+ 
+  float diff = 0;
+  if (iterations > dimensions.y) iterations = dimensions.y;
+  float intersect = 0.0f;
+  if (hierarchical) {
+    float t;
+    float start = temporal ? 1.0 + jitter() * temporalStride : 1.0;
+    int steps = temporal ? temporalHiZSteps : maxHiZSteps;
+    if (traceHiZ(pos, dir, dimensions, start, steps, iterations, t)) {
+      intersect = 1.0f;
+      diff = abs(textureLod(depth, pos.xy, 0).x - pos.z);
+    }
+    // Same blur footprint the linear march reaches after covering t pixels
+    step = 1.0 + 0.05 * t;
+  } else {
+    for (float i = 0; i < iterations; i += step) {
+      pos += dir * step;
+      float depth = texture(depth, pos.xy).x;
+      if (pos.x >= 1 || pos.x < 0 || pos.y >= 1 || pos.y < 0) break;
+      diff = abs(depth - pos.z);
+      if (depth < pos.z) {
+        intersect = 1.0f;
+        break;
+      }
+      step *= 1.05;
+    }
+  }
+  if (diff > 0.005) intersect = 0.0f;
+  vec3 back;
+  if (rough)
+    back = textureGrad(backBuffer, pos.xy, dPdx*step, dPdy*step).xyz;
+  else
+    back = texture(backBuffer, pos.xy).xyz;
+//  vec3 back = textureLod(backBuffer, pos.xy, 10).xyz;
+  
+  float edge = 1.0 - max(max(pos.x, 1.0-pos.x), max(pos.y, 1.0-pos.y));
+  edge = clamp(edge * 16, 0, 1);
+
+  return vec4(back, intersect * log2(edge+1));
+}
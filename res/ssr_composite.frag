@@ -0,0 +1,39 @@
+#version 330 core
+
+// Presents the scene with the deferred reflections on its opaque surfaces.
+// Water is drawn over this afterwards and applies its own fresnel.
+
+uniform sampler2D backBuffer;
+uniform sampler2D gbuffer;
+uniform sampler2D reflections;
+
+layout(location = 0) out vec3 color;
+
+layout(std140) uniform WorldData {
+    mat4 mvp;
+    vec3 eye;
+    float time;
+    vec2 dimensions;
+    float frame;        // Frame counter, wraps
+    mat4 prevMvp;       // Last frame's mvp, for reprojection
+};
+
+// gbuffer.frag
+vec3 decodeNormal(vec2 e);
+vec3 worldPosition(vec2 uv, float linear);
+
+void main()
+{
+  // Until a resize settles the scene keeps its old size and is scaled
+  vec2 uv = gl_FragCoord.xy / dimensions;
+  color = textureLod(backBuffer, uv, 0).rgb;
+  vec4 g = textureLod(gbuffer, uv, 0);
+  if (g.w == 0.0) return;
+
+  vec3 P = worldPosition(uv, g.w);
+  vec3 N = decodeNormal(g.xy);
+  vec3 V = normalize(eye - P);
+  vec4 reflected = textureLod(reflections, uv, 0);
+  float fresnel = 0.04 + 0.96 * pow(1.0 - max(dot(N, V), 0.0), 5.0);
+  color = mix(color, reflected.rgb, fresnel * reflected.a);
+}
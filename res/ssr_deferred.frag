@@ -0,0 +1,38 @@
+#version 330 core
+
+// Traces one reflection per pixel for everything in the G-buffer, terrain,
+// models and water alike. The result is not weighted by fresnel, each
+// material applies its own when it composites.
+
+uniform sampler2D gbuffer;
+uniform float maxRoughness = 0.25;  // Rougher surfaces blur too much to be worth a trace
+
+layout(location = 0) out vec4 reflection;   // Traced color and how much to trust it
+
+layout(std140) uniform WorldData {
+    mat4 mvp;
+    vec3 eye;
+    float time;
+    vec2 dimensions;
+    float frame;        // Frame counter, wraps
+    mat4 prevMvp;       // Last frame's mvp, for reprojection
+};
+
+// ssr.frag
+vec4 traceSS(vec3 P, vec3 dP, vec2 covar);
+// gbuffer.frag
+vec3 decodeNormal(vec2 e);
+vec3 worldPosition(vec2 uv, float linear);
+
+void main()
+{
+  ivec2 texel = ivec2(gl_FragCoord.xy);
+  vec4 g = texelFetch(gbuffer, texel, 0);
+  reflection = vec4(0);
+  if (g.w == 0.0 || g.z > maxRoughness) return;
+
+  vec3 P = worldPosition(gl_FragCoord.xy / vec2(textureSize(gbuffer, 0)), g.w);
+  vec3 N = decodeNormal(g.xy);
+  vec3 V = normalize(eye - P);
+  reflection = traceSS(P, reflect(-V, N), vec2(g.z, 0.0));
+}
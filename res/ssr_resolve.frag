@@ -0,0 +1,53 @@
+#version 330 core
+
+// Blends this frame's reduced resolution SSR trace with the reprojected
+// history. The history is clamped to the range of the current 3x3
+// neighborhood so stale reflections can't ghost behind moving objects.
+
+uniform sampler2D currentReflection;
+uniform sampler2D currentRefraction;
+uniform sampler2D surface;
+uniform sampler2D motion;
+uniform sampler2D historyReflection;
+uniform sampler2D historyRefraction;
+uniform float blend = 0.1;      // Weight of the current frame
+uniform bool reset = false;     // History is invalid, take the current frame as is
+
+layout(location = 0) out vec3 reflection;
+layout(location = 1) out vec3 refraction;
+
+void main()
+{
+  ivec2 texel = ivec2(gl_FragCoord.xy);
+  ivec2 size = textureSize(currentReflection, 0);
+  vec3 reflected = texelFetch(currentReflection, texel, 0).rgb;
+  vec3 refracted = texelFetch(currentRefraction, texel, 0).rgb;
+  reflection = reflected;
+  refraction = refracted;
+  if (reset || texelFetch(surface, texel, 0).w == 0.0) return;
+
+  vec2 uv = (vec2(texel) + 0.5) / vec2(size);
+  vec2 prevUV = uv + texelFetch(motion, texel, 0).xy;
+  if (any(lessThan(prevUV, vec2(0))) || any(greaterThan(prevUV, vec2(1)))) return;
+
+  // Neighborhood range, skipping texels with no water
+  vec3 minReflected = reflected, maxReflected = reflected;
+  vec3 minRefracted = refracted, maxRefracted = refracted;
+  for (int y = -1; y <= 1; y++) {
+    for (int x = -1; x <= 1; x++) {
+      ivec2 neighbor = clamp(texel + ivec2(x, y), ivec2(0), size - 1);
+      if (texelFetch(surface, neighbor, 0).w == 0.0) continue;
+      vec3 a = texelFetch(currentReflection, neighbor, 0).rgb;
+      vec3 b = texelFetch(currentRefraction, neighbor, 0).rgb;
+      minReflected = min(minReflected, a);
+      maxReflected = max(maxReflected, a);
+      minRefracted = min(minRefracted, b);
+      maxRefracted = max(maxRefracted, b);
+    }
+  }
+
+  vec3 historyReflected = clamp(texture(historyReflection, prevUV).rgb, minReflected, maxReflected);
+  vec3 historyRefracted = clamp(texture(historyRefraction, prevUV).rgb, minRefracted, maxRefracted);
+  reflection = mix(historyReflected, reflected, blend);
+  refraction = mix(historyRefracted, refracted, blend);
+}
@@ -0,0 +1,269 @@
+#include "Benchmark.hpp"
+#include "Camera.hpp"
+#include "Profiler.hpp"
+#include <stdio.h>
+#include <string.h>
+
+using namespace Testbed;
+
+//============================================================================//
+// Camera path                                                                //
+//============================================================================//
+
+bool CameraPath::load(const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    if (!file)
+    {
+        fprintf(stderr, "[Benchmark] Error loading %s\n", filename);
+        return false;
+    }
+
+    keys.clear();
+    segments.clear();
+    bool newSegment = false;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        char name[128];
+        CameraKey key;
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "segment %127s", name) == 1)
+        {
+            segments.push_back({name, keys.empty() ? 0.0 : keys.back().time});
+            newSegment = true;
+        }
+        else if (sscanf(line, "%lf %f %f %f %f %f", &key.time, &key.position.x, &key.position.y,
+                        &key.position.z, &key.pitch, &key.yaw) == 6)
+        {
+            // A segment starts at its first key
+            if (newSegment) segments.back().start = key.time;
+            newSegment = false;
+            keys.push_back(key);
+        }
+    }
+    fclose(file);
+
+    if (segments.empty() || (!keys.empty() && segments.front().start > keys.front().time))
+        segments.insert(segments.begin(), {"path", keys.empty() ? 0.0 : keys.front().time});
+    printf("[Benchmark] Loaded %zu keys in %zu segments from %s\n", keys.size(), segments.size(), filename);
+    return !keys.empty();
+}
+
+bool CameraPath::save(const char* filename) const
+{
+    FILE* file = fopen(filename, "w");
+    if (!file)
+    {
+        fprintf(stderr, "[Benchmark] Failed to write %s\n", filename);
+        return false;
+    }
+
+    fprintf(file, "# time x y z pitch yaw\n");
+    size_t segment = 0;
+    for (const CameraKey& key : keys)
+    {
+        while (segment < segments.size() && segments[segment].start <= key.time)
+            fprintf(file, "segment %s\n", segments[segment++].name.c_str());
+        fprintf(file, "%.6f %.6f %.6f %.6f %.6f %.6f\n", key.time, key.position.x,
+                key.position.y, key.position.z, key.pitch, key.yaw);
+    }
+    fclose(file);
+    printf("[Benchmark] Wrote %zu keys to %s\n", keys.size(), filename);
+    return true;
+}
+
+CameraKey CameraPath::sample(double t) const
+{
+    if (keys.empty()) return CameraKey{t, glm::vec3(0.0f), 0.0f, 0.0f};
+    if (t <= keys.front().time) return keys.front();
+    if (t >= keys.back().time) return keys.back();
+
+    // Binary search for the first key after t
+    size_t lo = 0, hi = keys.size() - 1;
+    while (hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (keys[mid].time <= t) lo = mid;
+        else hi = mid;
+    }
+
+    const CameraKey& a = keys[lo];
+    const CameraKey& b = keys[hi];
+    float s = float((t - a.time) / (b.time - a.time));
+    CameraKey key;
+    key.time = t;
+    key.position = glm::mix(a.position, b.position, s);
+    key.pitch = glm::mix(a.pitch, b.pitch, s);
+    key.yaw = glm::mix(a.yaw, b.yaw, s);
+    return key;
+}
+
+size_t CameraPath::segmentAt(double t) const
+{
+    size_t index = 0;
+    for (size_t i = 1; i < segments.size(); i++)
+        if (segments[i].start <= t) index = i;
+    return index;
+}
+
+//============================================================================//
+// Benchmark                                                                  //
+//============================================================================//
+
+void Benchmark::initialize(const Options& options)
+{
+    this->options = options;
+    time = 0.0;
+    frame = 0;
+
+    if (options.replay && path.load(options.replay))
+    {
+        mode = REPLAY;
+        results.resize(path.segments.size());
+        glGenQueries(QUERIES, queries);
+        for (int i = 0; i < QUERIES; i++)
+            querySegment[i] = -1;
+        printf("[Benchmark] Replaying %.2fs with dt %.4fs\n", path.duration(), options.dt);
+    }
+    else if (options.record)
+    {
+        mode = RECORD;
+        path.keys.clear();
+        path.segments.clear();
+        path.segments.push_back({"recorded", 0.0});
+        printf("[Benchmark] Recording camera path to %s\n", options.record);
+    }
+}
+
+double Benchmark::step(double dt)
+{
+    if (mode == NONE) return dt;
+
+    if (mode == REPLAY)
+    {
+        // Real frame time is what the CPU side of the report measures
+        if (frame > 0)
+            results[path.segmentAt(time)].cpu.add(dt);
+        if (time >= path.duration())
+            Testbed::stop();
+        dt = options.dt;
+    }
+    time += dt;
+    return dt;
+}
+
+void Benchmark::apply(Camera& camera)
+{
+    if (mode == RECORD)
+    {
+        path.keys.push_back({time, camera.getPosition(), camera.getPitch(), camera.getYaw()});
+    }
+    else if (mode == REPLAY)
+    {
+        CameraKey key = path.sample(time);
+        camera.setPosition(key.position);
+        camera.setDirection(key.pitch, key.yaw);
+    }
+}
+
+void Benchmark::beginFrame()
+{
+    if (mode != REPLAY) return;
+    // Pass timings in the report cover the replay only
+    if (frame == 0)
+        Graphics::Profiler::reset();
+    int index = frame % QUERIES;
+    resolve(index, false);
+    querySegment[index] = path.segmentAt(time);
+    glBeginQuery(GL_TIME_ELAPSED, queries[index]);
+}
+
+void Benchmark::endFrame()
+{
+    if (mode != REPLAY) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    frame++;
+}
+
+void Benchmark::resolve(int index, bool wait)
+{
+    if (querySegment[index] < 0) return;
+
+    GLint available = 0;
+    glGetQueryObjectiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available || wait)
+    {
+        GLuint64 elapsed;
+        glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &elapsed);
+        results[querySegment[index]].gpu.add(elapsed / 1e9);
+    }
+    querySegment[index] = -1;
+}
+
+void Benchmark::finish()
+{
+    if (mode == RECORD)
+    {
+        path.save(options.record);
+    }
+    else if (mode == REPLAY)
+    {
+        // The last frames may still be in flight, waiting is fine at exit
+        for (int i = 0; i < QUERIES; i++)
+            resolve(i, true);
+        glDeleteQueries(QUERIES, queries);
+
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            FrameStats::Summary cpu = results[i].cpu.summarize();
+            FrameStats::Summary gpu = results[i].gpu.summarize();
+            printf("[Benchmark] %-16s %5zu frames  cpu avg %7.3fms p95 %7.3fms  gpu avg %7.3fms p95 %7.3fms\n",
+                   path.segments[i].name.c_str(), cpu.frames, cpu.mean, cpu.p95, gpu.mean, gpu.p95);
+        }
+        if (options.benchmark)
+            writeReport(options.benchmark);
+    }
+    mode = NONE;
+}
+
+bool Benchmark::writeReport(const char* filename) const
+{
+    FILE* file = fopen(filename, "w");
+    if (!file)
+    {
+        fprintf(stderr, "[Benchmark] Failed to write %s\n", filename);
+        return false;
+    }
+
+    auto writeSummary = [&](const char* name, const FrameStats::Summary& s, bool last) {
+        fprintf(file, "      \"%s\": {\"frames\": %zu, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, "
+                      "\"p99_ms\": %.4f, \"max_ms\": %.4f, \"hitches\": %u}%s\n",
+                name, s.frames, s.mean, s.p50, s.p95, s.p99, s.max, s.hitches, last ? "" : ",");
+    };
+
+    fprintf(file, "{\n  \"path\": \"%s\",\n  \"dt\": %.6f,\n  \"width\": %d,\n  \"height\": %d,\n  \"segments\": [\n",
+            options.replay, options.dt, Testbed::getScreenWidth(), Testbed::getScreenHeight());
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        fprintf(file, "    {\n      \"name\": \"%s\",\n", path.segments[i].name.c_str());
+        writeSummary("cpu", results[i].cpu.summarize(), false);
+        writeSummary("gpu", results[i].gpu.summarize(), true);
+        fprintf(file, "    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+
+    // Mean GPU time of every profiler pass over the whole replay, one per
+    // line so reports of different runs can be lined up with awk
+    std::vector<Graphics::Profiler::ZoneStats> passes;
+    for (const Graphics::Profiler::ZoneStats& s : Graphics::Profiler::getStats())
+        if (s.frames) passes.push_back(s);
+    fprintf(file, "  ],\n  \"passes\": {\n");
+    for (size_t i = 0; i < passes.size(); i++)
+        fprintf(file, "    \"%s\": {\"depth\": %d, \"frames\": %d, \"mean_ms\": %.4f}%s\n", passes[i].name,
+                passes[i].depth, passes[i].frames, passes[i].mean, i + 1 < passes.size() ? "," : "");
+    fprintf(file, "  }\n}\n");
+    fclose(file);
+    printf("[Benchmark] Wrote report to %s\n", filename);
+    return true;
+}
@@ -0,0 +1,169 @@
+#include "FrameCapture.hpp"
+#include "RenderTarget.hpp"
+#include "lodepng.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+
+using namespace Testbed;
+
+namespace {
+    bool endsWith(const std::string& s, const char* suffix)
+    {
+        size_t n = strlen(suffix);
+        return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+    }
+
+    // Runs on a worker, rgba is top row first
+    void writeImage(const std::string& filename, const std::vector<unsigned char>& rgba, int width, int height)
+    {
+        if (endsWith(filename, ".ppm"))
+        {
+            FILE* file = fopen(filename.c_str(), "wb");
+            if (!file)
+            {
+                fprintf(stderr, "[Capture] Failed to write %s\n", filename.c_str());
+                return;
+            }
+            fprintf(file, "P6\n%d %d\n255\n", width, height);
+            std::vector<unsigned char> row(width * 3);
+            for (int y = 0; y < height; y++)
+            {
+                const unsigned char* in = &rgba[size_t(y) * width * 4];
+                for (int x = 0; x < width; x++)
+                    memcpy(&row[x * 3], &in[x * 4], 3);
+                fwrite(row.data(), 1, row.size(), file);
+            }
+            fclose(file);
+            return;
+        }
+
+        unsigned error = lodepng::encode(filename, rgba, width, height);
+        if (error)
+            fprintf(stderr, "[Capture] Failed to write %s: %s\n", filename.c_str(), lodepng_error_text(error));
+    }
+}
+
+void FrameCapture::initialize(unsigned buffers, unsigned maxEncodes)
+{
+    release();
+    this->maxEncodes = maxEncodes;
+    slots.resize(buffers);
+    for (Slot& slot : slots)
+    {
+        glGenBuffers(1, &slot.buffer);
+        slot.size = 0;
+        slot.fence = 0;
+    }
+    next = 0;
+    captured = 0;
+    dropped = 0;
+    printf("[Capture] Reading back through %u buffers\n", buffers);
+}
+
+bool FrameCapture::capture(const RenderTarget& target, int width, int height, const std::string& filename)
+{
+    pruneEncodes();
+    Slot& slot = slots[next];
+    if (slot.fence || encodes.size() >= maxEncodes)
+    {
+        if (dropped++ % 100 == 0)
+            printf("[Capture] Falling behind, %u captures dropped\n", dropped);
+        return false;
+    }
+
+    // Four bytes per pixel keeps every row aligned for the default pack alignment
+    size_t size = size_t(width) * height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (slot.size != size)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        slot.size = size;
+    }
+    target.bindRead();
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = width;
+    slot.height = height;
+    slot.filename = filename;
+    next = (next + 1) % slots.size();
+    return true;
+}
+
+void FrameCapture::update()
+{
+    for (Slot& slot : slots)
+    {
+        if (!slot.fence) continue;
+        GLenum status = glClientWaitSync(slot.fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+            collect(slot);
+    }
+    pruneEncodes();
+}
+
+void FrameCapture::collect(Slot& slot)
+{
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+
+    // Copying out frees the buffer for the next capture right away. GL rows
+    // start at the bottom, so flip on the way.
+    auto pixels = std::make_shared<std::vector<unsigned char>>(slot.size);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const unsigned char* data = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+    if (!data)
+    {
+        fprintf(stderr, "[Capture] Failed to map readback of %s\n", slot.filename.c_str());
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return;
+    }
+    size_t row = size_t(slot.width) * 4;
+    for (int y = 0; y < slot.height; y++)
+        memcpy(&(*pixels)[y * row], data + (slot.height - 1 - y) * row, row);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    int width = slot.width;
+    int height = slot.height;
+    std::string filename = slot.filename;
+    encodes.push_back(Jobs::run([pixels, width, height, filename] {
+        writeImage(filename, *pixels, width, height);
+    }));
+    captured++;
+}
+
+void FrameCapture::pruneEncodes()
+{
+    encodes.erase(std::remove_if(encodes.begin(), encodes.end(), [](const Jobs::Job& job) {
+        return Jobs::isDone(job);
+    }), encodes.end());
+}
+
+void FrameCapture::finish()
+{
+    // Oldest first, so files complete in the order they were captured
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        Slot& slot = slots[(next + i) % slots.size()];
+        if (!slot.fence) continue;
+        glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(-1));
+        collect(slot);
+    }
+    Jobs::wait(encodes);
+    encodes.clear();
+    if (captured || dropped)
+        printf("[Capture] Wrote %u frames, dropped %u\n", captured, dropped);
+}
+
+void FrameCapture::release()
+{
+    if (slots.empty()) return;
+    finish();
+    for (Slot& slot : slots)
+        glDeleteBuffers(1, &slot.buffer);
+    slots.clear();
+}
@@ -0,0 +1,154 @@
+#include "FrameStats.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <math.h>
+
+using namespace Testbed;
+
+namespace {
+    // Nearest-rank percentile of a sorted range
+    double percentile(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty()) return 0.0;
+        size_t rank = (size_t)ceil(p / 100.0 * sorted.size());
+        if (rank > 0) rank--;
+        return sorted[std::min(rank, sorted.size() - 1)];
+    }
+
+    bool endsWith(const char* str, const char* suffix)
+    {
+        size_t a = strlen(str), b = strlen(suffix);
+        return a >= b && !strcmp(str + a - b, suffix);
+    }
+}
+
+FrameStats::FrameStats(size_t capacity, double budget) :
+    times(std::max<size_t>(capacity, 1)), next(0), count(0), budget(budget),
+    totalFrames(0), totalHitches(0), totalTime(0.0)
+{
+}
+
+void FrameStats::add(double dt)
+{
+    double ms = 1000.0 * dt;
+    times[next] = ms;
+    next = (next + 1) % times.size();
+    if (count < times.size()) count++;
+
+    totalFrames++;
+    totalTime += ms;
+    if (ms > budget) totalHitches++;
+}
+
+FrameStats::Summary FrameStats::summarize() const
+{
+    Summary summary = {count, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+    if (!count) return summary;
+
+    std::vector<double> sorted(times.begin(), times.begin() + count);
+    std::sort(sorted.begin(), sorted.end());
+    for (double t : sorted)
+    {
+        summary.mean += t;
+        if (t > budget) summary.hitches++;
+    }
+    summary.mean /= count;
+    summary.p50 = percentile(sorted, 50.0);
+    summary.p95 = percentile(sorted, 95.0);
+    summary.p99 = percentile(sorted, 99.0);
+    summary.max = sorted.back();
+    return summary;
+}
+
+std::vector<unsigned> FrameStats::histogram(double bucket, size_t bins) const
+{
+    std::vector<unsigned> result(bins, 0);
+    if (!bins) return result;
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t bin = (size_t)(times[i] / bucket);
+        result[std::min(bin, bins - 1)]++;
+    }
+    return result;
+}
+
+void FrameStats::print() const
+{
+    Summary s = summarize();
+    printf("Frame Time: avg %.3fms (%.2ffps) p50 %.3fms p95 %.3fms p99 %.3fms max %.3fms, %u/%zu over %.2fms\n",
+           s.mean, s.mean > 0.0 ? 1000.0 / s.mean : 0.0, s.p50, s.p95, s.p99, s.max, s.hitches, s.frames, budget);
+}
+
+bool FrameStats::write(const char* filename, const char* label) const
+{
+    if (!label) label = "run";
+    if (endsWith(filename, ".json"))
+        return writeJSON(filename, label);
+    return writeCSV(filename, label);
+}
+
+bool FrameStats::writeCSV(const char* filename, const char* label) const
+{
+    FILE* file = fopen(filename, "a+");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to write %s\n", filename);
+        return false;
+    }
+
+    // Only write the header into a new file
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) == 0)
+        fprintf(file, "label,frames,mean_ms,p50_ms,p95_ms,p99_ms,max_ms,hitches,budget_ms,total_frames,total_hitches\n");
+
+    Summary s = summarize();
+    fprintf(file, "%s,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%u,%.4f,%zu,%u\n",
+            label, s.frames, s.mean, s.p50, s.p95, s.p99, s.max, s.hitches, budget, totalFrames, totalHitches);
+    fclose(file);
+    printf("Wrote frame statistics to %s\n", filename);
+    return true;
+}
+
+bool FrameStats::writeJSON(const char* filename, const char* label) const
+{
+    FILE* file = fopen(filename, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to write %s\n", filename);
+        return false;
+    }
+
+    Summary s = summarize();
+    fprintf(file, "{\n  \"label\": \"%s\",\n  \"budget_ms\": %.4f,\n", label, budget);
+    fprintf(file, "  \"total_frames\": %zu,\n  \"total_hitches\": %u,\n  \"total_ms\": %.4f,\n",
+            totalFrames, totalHitches, totalTime);
+    fprintf(file, "  \"frames\": %zu,\n  \"mean_ms\": %.4f,\n  \"p50_ms\": %.4f,\n  \"p95_ms\": %.4f,\n"
+                  "  \"p99_ms\": %.4f,\n  \"max_ms\": %.4f,\n  \"hitches\": %u,\n",
+            s.frames, s.mean, s.p50, s.p95, s.p99, s.max, s.hitches);
+
+    std::vector<unsigned> bins = histogram();
+    fprintf(file, "  \"histogram_bucket_ms\": 1.0,\n  \"histogram\": [");
+    for (size_t i = 0; i < bins.size(); i++)
+        fprintf(file, "%s%u", i ? ", " : "", bins[i]);
+    fprintf(file, "],\n");
+
+    // Oldest frame first
+    fprintf(file, "  \"times_ms\": [");
+    size_t start = count < times.size() ? 0 : next;
+    for (size_t i = 0; i < count; i++)
+        fprintf(file, "%s%.4f", i ? ", " : "", times[(start + i) % times.size()]);
+    fprintf(file, "]\n}\n");
+    fclose(file);
+    printf("Wrote frame statistics to %s\n", filename);
+    return true;
+}
+
+void FrameStats::reset()
+{
+    next = 0;
+    count = 0;
+    totalFrames = 0;
+    totalHitches = 0;
+    totalTime = 0.0;
+}
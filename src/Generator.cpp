@@ -1,4 +1,5 @@
 #include "LEAN.hpp"
+#include "Jobs.hpp"
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -10,7 +11,9 @@ int main(int argc, char* argv[]) {
   float scale = 1.0f;
   if (argc == 4) scale = atof(argv[3]);
   printf("Generating LEAN map from %s with scale %f\n", argv[1], scale);
+  Testbed::Jobs::initialize();
   LEANMap lean = LEANMap::generate(argv[1], scale);
+  Testbed::Jobs::shutdown();
   printf("Writing to %s\n", argv[2]);
   lean.write(argv[2]);
 }
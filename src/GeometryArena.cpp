@@ -0,0 +1,176 @@
+#include "GeometryArena.hpp"
+#include <stdio.h>
+#include <string.h>
+
+using namespace Graphics;
+
+void GeometryArena::initialize(const std::vector<Attrib>& attributes, size_t stride, size_t vertexCapacity,
+                               size_t indexCapacity, bool indirect)
+{
+    release();
+    this->attributes = attributes;
+    this->stride = stride;
+    this->vertexCapacity = vertexCapacity;
+    this->indexCapacity = indexCapacity;
+    vertices = 0;
+    indices = 0;
+    // Indirect commands only honor baseInstance where base instances exist
+    baseInstance = indirect && (GLEW_VERSION_4_2 || GLEW_ARB_base_instance);
+    multiDraw = indirect && (GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && baseInstance));
+
+    Surface& surface = geometry.surface;
+    surface = {GL_TRIANGLES, 0, 0, 0, 0, 0, 0, GL_UNSIGNED_INT};
+    glGenVertexArrays(1, &surface.vao);
+    glGenBuffers(1, &surface.vbo);
+    glGenBuffers(1, &surface.ibo);
+    glBindVertexArray(surface.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, surface.vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertexCapacity * stride, nullptr, GL_STATIC_DRAW);
+    setVertexAttributes(attributes, stride);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, surface.ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    if (multiDraw)
+        glGenBuffers(1, &commandBuffer);
+    printf("[GeometryArena] %zu vertices, %zu indices, buckets drawn with %s\n", vertexCapacity, indexCapacity,
+           multiDraw ? "glMultiDrawElementsIndirect" : "base-vertex draws");
+}
+
+void GeometryArena::grow(GLuint& buffer, size_t used, size_t size)
+{
+    // The copy targets leave the vertex array's bindings alone
+    GLuint larger;
+    glGenBuffers(1, &larger);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, larger);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STATIC_DRAW);
+    if (used)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+    }
+    glDeleteBuffers(1, &buffer);
+    buffer = larger;
+}
+
+GeometryArena::Range GeometryArena::add(const Buffer& data, const std::vector<GLuint>& meshIndices)
+{
+    Testbed::assert(data.stride == stride, "[GeometryArena] Vertex size doesn't match the arena");
+    Surface& surface = geometry.surface;
+
+    if (vertices + data.num > vertexCapacity)
+    {
+        while (vertexCapacity < vertices + data.num)
+            vertexCapacity = vertexCapacity ? vertexCapacity * 2 : 1024;
+        grow(surface.vbo, vertices * stride, vertexCapacity * stride);
+        glBindVertexArray(surface.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, surface.vbo);
+        setVertexAttributes(attributes, stride);
+        glBindVertexArray(0);
+    }
+    if (indices + meshIndices.size() > indexCapacity)
+    {
+        while (indexCapacity < indices + meshIndices.size())
+            indexCapacity = indexCapacity ? indexCapacity * 2 : 4096;
+        grow(surface.ibo, indices * sizeof(GLuint), indexCapacity * sizeof(GLuint));
+        glBindVertexArray(surface.vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, surface.ibo);
+        glBindVertexArray(0);
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, surface.vbo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, vertices * stride, data.size, data.data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, surface.ibo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, indices * sizeof(GLuint), meshIndices.size() * sizeof(GLuint), meshIndices.data());
+
+    // Indices stay relative to the mesh, the base vertex offsets them at draw time
+    Range range = {GLuint(meshIndices.size()), GLuint(indices), GLint(vertices)};
+    vertices += data.num;
+    indices += meshIndices.size();
+    surface.num = indices;
+    return range;
+}
+
+void GeometryArena::setInstanceFormat(GLuint firstLocation, const std::vector<Attrib>& format, size_t stride)
+{
+    Testbed::assert(geometry.instances == 0, "[GeometryArena] Instance format already set");
+    geometry = createInstancedSurface(geometry.surface, firstLocation, format, stride, 64);
+    glBindVertexArray(0);
+    instanceAttributes = format;
+    firstInstanceLocation = firstLocation;
+    instanceOffset = 0;
+}
+
+void GeometryArena::updateInstances(const Buffer& instances)
+{
+    Graphics::updateInstances(geometry, instances);
+}
+
+void GeometryArena::draw(const std::vector<Command>& commands)
+{
+    if (commands.empty() || !geometry.surface.vao) return;
+    // The last instance upload failed, the buffer holds nothing usable
+    if (geometry.instances && geometry.count == 0) return;
+    glBindVertexArray(geometry.surface.vao);
+
+    if (multiDraw)
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        if (commands.size() > indirectCapacity)
+        {
+            while (indirectCapacity < commands.size())
+                indirectCapacity = indirectCapacity ? indirectCapacity * 2 : 64;
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, indirectCapacity * sizeof(Command), nullptr, GL_STREAM_DRAW);
+        }
+        size_t size = commands.size() * sizeof(Command);
+        void* data = glMapBufferRange(GL_DRAW_INDIRECT_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (!data)
+        {
+            fprintf(stderr, "[GeometryArena] Failed to map indirect buffer, skipping %zu commands\n", commands.size());
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            return;
+        }
+        memcpy(data, commands.data(), size);
+        glUnmapBuffer(GL_DRAW_INDIRECT_BUFFER);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, commands.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        return;
+    }
+
+    // GL 3.3 has no base instance, the instance attributes are pointed at it instead
+    for (const Command& command : commands)
+    {
+        if (command.instanceCount == 0) continue;
+        const GLvoid* offset = (const GLvoid*)(command.firstIndex * sizeof(GLuint));
+        if (baseInstance)
+        {
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, offset,
+                                                          command.instanceCount, command.baseVertex, command.baseInstance);
+            continue;
+        }
+        if (geometry.instances && command.baseInstance != instanceOffset)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, geometry.instances);
+            setVertexAttributes(instanceAttributes, geometry.stride, firstInstanceLocation, 1,
+                                size_t(command.baseInstance) * geometry.stride);
+            instanceOffset = command.baseInstance;
+        }
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, offset,
+                                          command.instanceCount, command.baseVertex);
+    }
+}
+
+void GeometryArena::release()
+{
+    if (!geometry.surface.vao) return;
+    if (geometry.instances)
+        deleteSurface(geometry);
+    else
+        deleteSurface(geometry.surface);
+    glDeleteBuffers(1, &commandBuffer);
+    commandBuffer = 0;
+    indirectCapacity = 0;
+    vertices = 0;
+    indices = 0;
+    instanceAttributes.clear();
+}
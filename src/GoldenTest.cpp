@@ -0,0 +1,222 @@
+#include "GoldenTest.hpp"
+#include "Camera.hpp"
+#include "Profiler.hpp"
+#include "RenderTarget.hpp"
+#include "lodepng.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+using namespace Testbed;
+
+// A pixel fails when any channel is further than TOLERANCE from the reference,
+// a pose fails when more than MAX_BAD of its pixels do. That absorbs rounding
+// differences between drivers while still catching a pass that goes missing.
+namespace {
+    const int TOLERANCE = 8;
+    const double MAX_BAD = 0.002;
+    const int DIFF_SCALE = 8;   // Differences are amplified in the written diff image
+
+    void writeImage(const std::string& filename, const std::vector<unsigned char>& rgba, int width, int height)
+    {
+        unsigned error = lodepng::encode(filename, rgba, width, height);
+        if (error)
+            fprintf(stderr, "[Golden] Failed to write %s: %s\n", filename.c_str(), lodepng_error_text(error));
+    }
+}
+
+void GoldenTest::initialize(const Options& options)
+{
+    this->options = options;
+    running = false;
+    if (!options.golden) return;
+
+    directory = options.golden;
+    if (!poses.load((directory + "/poses.txt").c_str()))
+        return;
+    running = true;
+    update = options.updateGolden;
+    pose = 0;
+    frame = 0;
+    failures = 0;
+    results.clear();
+    printf("[Golden] %s %zu poses in %s\n", update ? "Updating" : "Comparing", poses.segments.size(), options.golden);
+}
+
+double GoldenTest::step(double dt)
+{
+    return running ? options.dt : dt;
+}
+
+void GoldenTest::apply(Camera& camera)
+{
+    if (!running) return;
+    CameraKey key = poses.sample(poses.segments[pose].start);
+    camera.setPosition(key.position);
+    camera.setDirection(key.pitch, key.yaw);
+}
+
+float GoldenTest::getTime() const
+{
+    return running ? float(poses.segments[pose].start) : 0.0f;
+}
+
+void GoldenTest::endFrame(const RenderTarget& target, int width, int height)
+{
+    if (!running) return;
+
+    // Samples from before this point may still belong to the previous pose
+    if (++frame == SETTLE)
+        Graphics::Profiler::reset();
+    if (frame < SETTLE + MEASURE)
+        return;
+
+    Result result = {poses.segments[pose].name, "pass", 0.0, 0.0, {}};
+    for (const Graphics::Profiler::ZoneStats& s : Graphics::Profiler::getStats())
+        if (s.samples)
+            result.zones.push_back({s.name, s.depth, s.avg, s.max});
+
+    // Stalls on the frame, which is fine here. Rows come bottom first.
+    std::vector<unsigned char> rgba(size_t(width) * height * 4);
+    std::vector<unsigned char> row(size_t(width) * 4);
+    target.bindRead();
+    GLint alignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &rgba[0]);
+    glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+    for (int y = 0; y < height / 2; y++)
+    {
+        unsigned char* top = &rgba[size_t(y) * row.size()];
+        unsigned char* bottom = &rgba[size_t(height - 1 - y) * row.size()];
+        std::copy(top, top + row.size(), row.begin());
+        std::copy(bottom, bottom + row.size(), top);
+        std::copy(row.begin(), row.end(), bottom);
+    }
+    for (size_t i = 3; i < rgba.size(); i += 4)
+        rgba[i] = 255;
+
+    compare(result, rgba, width, height);
+    if (strcmp(result.status, "pass") && strcmp(result.status, "updated"))
+        failures++;
+    printf("[Golden] %-16s %-8s %6.3f%% of pixels differ  psnr %6.2fdB\n",
+           result.name.c_str(), result.status, result.bad * 100.0, result.psnr);
+    results.push_back(result);
+
+    frame = 0;
+    if (++pose == poses.segments.size())
+    {
+        running = false;
+        Testbed::stop();
+    }
+}
+
+void GoldenTest::compare(Result& result, const std::vector<unsigned char>& rgba, int width, int height)
+{
+    std::string reference = directory + "/" + result.name + ".png";
+    std::string actual = "golden_" + result.name + ".png";
+    if (update)
+    {
+        writeImage(reference, rgba, width, height);
+        result.status = "updated";
+        return;
+    }
+
+    std::vector<unsigned char> expected;
+    unsigned w, h;
+    // Only --update-golden writes references, a missing one fails
+    if (lodepng::decode(expected, w, h, reference))
+    {
+        result.status = "missing";
+        writeImage(actual, rgba, width, height);
+        fprintf(stderr, "[Golden] No reference %s, run make golden-update\n", reference.c_str());
+        return;
+    }
+    if (int(w) != width || int(h) != height)
+    {
+        result.status = "size";
+        writeImage(actual, rgba, width, height);
+        return;
+    }
+
+    std::vector<unsigned char> diff(rgba.size());
+    size_t bad = 0;
+    double error = 0.0;
+    for (size_t i = 0; i < rgba.size(); i += 4)
+    {
+        int worst = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            int d = abs(int(rgba[i + c]) - int(expected[i + c]));
+            error += d * d;
+            worst = d > worst ? d : worst;
+            diff[i + c] = std::min(d * DIFF_SCALE, 255);
+        }
+        diff[i + 3] = 255;
+        if (worst > TOLERANCE) bad++;
+    }
+
+    size_t pixels = size_t(width) * height;
+    double mse = error / (pixels * 3.0);
+    result.bad = double(bad) / pixels;
+    result.psnr = mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+    if (result.bad > MAX_BAD)
+    {
+        result.status = "fail";
+        writeImage(actual, rgba, width, height);
+        writeImage("golden_" + result.name + "_diff.png", diff, width, height);
+    }
+}
+
+void GoldenTest::finish()
+{
+    if (!options.golden || results.empty()) return;
+    if (running)
+        printf("[Golden] Stopped after %zu of %zu poses\n", results.size(), poses.segments.size());
+    else if (!update)
+        printf("[Golden] %zu of %zu poses passed\n", results.size() - failures, results.size());
+
+    // GPU time per pass of every pose, the same zones the profiler prints
+    for (const Result& result : results)
+    {
+        printf("[Golden] %s\n", result.name.c_str());
+        for (const Zone& zone : result.zones)
+            printf("[Golden]   %*s%-*s avg %7.3fms  max %7.3fms\n",
+                   2 * zone.depth, "", 16 - 2 * zone.depth, zone.name.c_str(), zone.avg, zone.max);
+    }
+    if (options.benchmark)
+        writeReport(options.benchmark);
+    if (running)
+        failures++;
+    running = false;
+}
+
+bool GoldenTest::writeReport(const char* filename) const
+{
+    FILE* file = fopen(filename, "w");
+    if (!file)
+    {
+        fprintf(stderr, "[Golden] Failed to write %s\n", filename);
+        return false;
+    }
+
+    fprintf(file, "{\n  \"golden\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n  \"poses\": [\n",
+            directory.c_str(), Testbed::getScreenWidth(), Testbed::getScreenHeight());
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result& result = results[i];
+        fprintf(file, "    {\n      \"name\": \"%s\",\n      \"status\": \"%s\",\n"
+                      "      \"bad_fraction\": %.6f,\n      \"psnr_db\": %.3f,\n      \"passes\": {\n",
+                result.name.c_str(), result.status, result.bad, result.psnr);
+        for (size_t j = 0; j < result.zones.size(); j++)
+            fprintf(file, "        \"%s\": {\"avg_ms\": %.4f, \"max_ms\": %.4f}%s\n", result.zones[j].name.c_str(),
+                    result.zones[j].avg, result.zones[j].max, j + 1 < result.zones.size() ? "," : "");
+        fprintf(file, "      }\n    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    printf("[Golden] Wrote report to %s\n", filename);
+    return true;
+}
@@ -0,0 +1,82 @@
+#include "HiZ.hpp"
+#include <stdio.h>
+
+void HiZ::initialize()
+{
+    glGenVertexArrays(1, &vao);
+    reloadShaders();
+}
+
+void HiZ::reloadShaders()
+{
+    shader.release();
+    GLuint vs = Graphics::loadShader("res/fullscreen.vert", GL_VERTEX_SHADER);
+    GLuint fs = Graphics::loadShader("res/hiz.frag", GL_FRAGMENT_SHADER);
+    shader = Graphics::createProgram({vs, fs});
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    shader["source"].set(0);
+}
+
+void HiZ::resize(GLuint width, GLuint height)
+{
+    RenderTarget::Desc desc;
+    desc.width = width;
+    desc.height = height;
+    desc.color = {GL_R32F};
+    desc.depth = GL_NONE;
+    pyramid = RenderTarget::create(desc);
+    glBindTexture(GL_TEXTURE_2D, pyramid.getTexture(0));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    printf("[HiZ] Allocated %ux%u pyramid with %d levels\n", width, height, pyramid.getLevels());
+}
+
+void HiZ::build(GLuint depthTexture)
+{
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(vao);
+    shader.use();
+    glActiveTexture(GL_TEXTURE0);
+
+    // Level 0 is a straight copy of the depth buffer
+    shader["copy"].set(true);
+    pyramid.setLevel(0);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    // Every other level reads only the one above it, so restricting the
+    // sampled range keeps the level being written out of the feedback loop
+    shader["copy"].set(false);
+    GLuint texture = pyramid.getTexture(0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    for (int level = 1; level < pyramid.getLevels(); level++)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+        pyramid.setLevel(level);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, pyramid.getLevels() - 1);
+    pyramid.setLevel(0);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void HiZ::release()
+{
+    pyramid.release();
+    shader.release();
+    if (vao)
+        glDeleteVertexArrays(1, &vao);
+    vao = 0;
+}
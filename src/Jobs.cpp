@@ -0,0 +1,237 @@
+#include "Jobs.hpp"
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using namespace Testbed;
+using Jobs::Job;
+
+// Every thread owns a deque, the owner pushes and pops at the back while idle
+// threads steal from the front of the others. Threads that are not workers
+// (the main thread) share queue 0, so they can submit and help while waiting.
+
+class Testbed::Jobs::Task
+{
+public:
+    Task(std::function<void()> fn) : fn(fn), pending(1), done(false) { }
+    std::function<void()> fn;
+    std::atomic<int> pending;   // Unfinished dependencies, plus one until submitted
+    std::atomic<bool> done;
+    std::mutex mutex;
+    std::vector<Job> successors;
+};
+
+namespace {
+    const unsigned MAX_THREADS = 64;
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    Queue queues[MAX_THREADS + 1];
+    std::vector<std::thread> workers;
+    unsigned numQueues = 1;
+    std::atomic<int> queued(0);
+    std::atomic<bool> quit(false);
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    thread_local unsigned threadIndex = 0;
+
+    void schedule(const Job& job)
+    {
+        Queue& queue = queues[threadIndex];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(job);
+        }
+        // Under the sleep lock, so a worker can't check the count and then
+        // block after this notify has already gone out
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued++;
+        }
+        wake.notify_one();
+    }
+
+    void release(const Job& job)
+    {
+        if (--job->pending == 0)
+            schedule(job);
+    }
+
+    bool findWork(Job& job)
+    {
+        // Newest job from our own queue keeps its data warm in cache
+        {
+            Queue& queue = queues[threadIndex];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.jobs.empty())
+            {
+                job = std::move(queue.jobs.back());
+                queue.jobs.pop_back();
+                queued--;
+                return true;
+            }
+        }
+
+        // Oldest job from someone else's, those tend to be the biggest
+        for (unsigned i = 1; i < numQueues; i++)
+        {
+            Queue& queue = queues[(threadIndex + i) % numQueues];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.jobs.empty())
+            {
+                job = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+                queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void execute(const Job& job)
+    {
+        job->fn();
+        job->fn = nullptr;
+
+        std::vector<Job> successors;
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->done = true;
+            successors.swap(job->successors);
+        }
+        for (const Job& successor : successors)
+            release(successor);
+    }
+
+    void workerLoop(unsigned index)
+    {
+        threadIndex = index;
+        Job job;
+        while (true)
+        {
+            if (findWork(job))
+            {
+                execute(job);
+                job.reset();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            if (quit && queued == 0) return;
+            wake.wait(lock, [] { return queued > 0 || quit; });
+        }
+    }
+}
+
+void Jobs::initialize(unsigned threads)
+{
+    if (!workers.empty()) return;
+    if (threads == 0)
+    {
+        unsigned cores = std::thread::hardware_concurrency();
+        threads = cores > 1 ? cores - 1 : 1;
+    }
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    printf("[Jobs] Starting %u worker threads\n", threads);
+
+    quit = false;
+    numQueues = threads + 1;
+    for (unsigned i = 1; i <= threads; i++)
+        workers.push_back(std::thread(&workerLoop, i));
+}
+
+void Jobs::shutdown()
+{
+    if (workers.empty()) return;
+    printf("[Jobs] Shutting down\n");
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+    numQueues = 1;
+}
+
+unsigned Jobs::getThreadCount()
+{
+    return workers.size();
+}
+
+Job Jobs::run(std::function<void()> fn)
+{
+    Job job = std::make_shared<Task>(fn);
+    release(job);
+    return job;
+}
+
+Job Jobs::run(std::function<void()> fn, const std::vector<Job>& dependencies)
+{
+    Job job = std::make_shared<Task>(fn);
+    for (const Job& dependency : dependencies)
+    {
+        if (!dependency) continue;
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (dependency->done) continue;
+        job->pending++;
+        dependency->successors.push_back(job);
+    }
+    release(job);
+    return job;
+}
+
+Job Jobs::then(const Job& job, std::function<void()> fn)
+{
+    return run(fn, {job});
+}
+
+bool Jobs::isDone(const Job& job)
+{
+    return !job || job->done;
+}
+
+void Jobs::wait(const Job& job)
+{
+    Job other;
+    while (!isDone(job))
+    {
+        if (findWork(other))
+        {
+            execute(other);
+            other.reset();
+        }
+        else
+            std::this_thread::yield();
+    }
+}
+
+void Jobs::wait(const std::vector<Job>& jobs)
+{
+    for (const Job& job : jobs)
+        wait(job);
+}
+
+void Jobs::parallelFor(size_t begin, size_t end, size_t grain, std::function<void(size_t, size_t)> fn)
+{
+    if (begin >= end) return;
+    if (grain == 0) grain = 1;
+
+    // Queue all but the first chunk, then work on that one ourselves
+    std::vector<Job> jobs;
+    jobs.reserve((end - begin) / grain + 1);
+    for (size_t first = begin + grain; first < end; first += grain)
+    {
+        size_t last = first + grain < end ? first + grain : end;
+        jobs.push_back(run([&fn, first, last] { fn(first, last); }));
+    }
+    fn(begin, begin + grain < end ? begin + grain : end);
+    wait(jobs);
+}
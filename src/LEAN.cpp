@@ -1,6 +1,7 @@
 #include "LEAN.hpp"
 #include <stdio.h>
 #include "lodepng.h"
+#include "Jobs.hpp"
 
 // A lean file consists of the raw dimensions followed by raw gradient
 // and raw covariance buffers
@@ -69,31 +70,34 @@ LEANMap LEANMap::generate(const char* filename, float scale) {
     return scale * (v / 255.0f);
   };
 
+  // Rows are independent, split them across the job system
   LEANMap output(width, height);
-  for (int x = 0; x < (int)width; x++) {
-    for (int y = 0; y < (int)height; y++) {
-      // Sample texture
-      float x1 = sample(x-1, y);
-      float x2 = sample(x+1, y);
-      float y1 = sample(x, y-1);
-      float y2 = sample(x, y+1);
-      float center = sample(x, y);
-      
-      // Calculate normal
-      vec3 dx = vec3(x+1, y, x2) - vec3(x-1, y, x1);
-      vec3 dy = vec3(x, y+1, y2) - vec3(x, y-1, y1);
-      dx = glm::normalize(dx);
-      dy = glm::normalize(dy);
-      vec3 normal = glm::cross(dx, dy);
-      normal /= normal.z;
+  Testbed::Jobs::parallelFor(0, height, 16, [&](size_t first, size_t last) {
+    for (int y = (int)first; y < (int)last; y++) {
+      for (int x = 0; x < (int)width; x++) {
+        // Sample texture
+        float x1 = sample(x-1, y);
+        float x2 = sample(x+1, y);
+        float y1 = sample(x, y-1);
+        float y2 = sample(x, y+1);
+        float center = sample(x, y);
+        
+        // Calculate normal
+        vec3 dx = vec3(x+1, y, x2) - vec3(x-1, y, x1);
+        vec3 dy = vec3(x, y+1, y2) - vec3(x, y-1, y1);
+        dx = glm::normalize(dx);
+        dy = glm::normalize(dy);
+        vec3 normal = glm::cross(dx, dy);
+        normal /= normal.z;
 
-      float invS = 1.0f / 1024.0f;
-      // Store the results in memory
-      unsigned index = y*width + x;
-      output.grad[index] = vec3(normal.x, normal.y, center);
-      output.covar[index] = vec3(normal.x*normal.x + invS, normal.y*normal.y + invS, normal.x*normal.y);
+        float invS = 1.0f / 1024.0f;
+        // Store the results in memory
+        unsigned index = y*width + x;
+        output.grad[index] = vec3(normal.x, normal.y, center);
+        output.covar[index] = vec3(normal.x*normal.x + invS, normal.y*normal.y + invS, normal.x*normal.y);
+      }
     }
-  }
+  });
 
   return output;
 }
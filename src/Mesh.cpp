@@ -1,9 +1,12 @@
 #include "Mesh.hpp"
+#include "Testbed.hpp"
+#include <stdio.h>
+#include <string.h>
 
 
 Graphics::Surface Graphics::createSurface(const Buffer& data, const std::vector<Attrib>& attributes)
 {
-    Surface surface = {GL_TRIANGLES, 0, 0, 0, GLsizei(data.num)};
+    Surface surface = {GL_TRIANGLES, 0, 0, 0, GLsizei(data.num), 0, 0, GL_UNSIGNED_INT};
     glGenBuffers(1, &surface.vbo);
     glBindBuffer(GL_ARRAY_BUFFER, surface.vbo);
     glBufferData(GL_ARRAY_BUFFER, data.size, data.getPointerAs<GLubyte>(), GL_STATIC_DRAW);
@@ -11,42 +14,179 @@ Graphics::Surface Graphics::createSurface(const Buffer& data, const std::vector<
     glGenVertexArrays(1, &surface.vao);
     glBindVertexArray(surface.vao);
     glBindBuffer(GL_ARRAY_BUFFER, surface.vbo);
-
-    GLubyte* offset = 0;
-    for (size_t i = 0; i < attributes.size(); i++)
-    {
-        const Attrib& attrib = attributes[i];
-        glEnableVertexAttribArray(i);
-        glVertexAttribPointer(i, attrib.size, attrib.type, GL_FALSE, data.stride, offset);
-        offset += attrib.size * 4; // TODO support things other than 32 bit
-    }
+    setVertexAttributes(attributes, data.stride);
 
     return surface;
 }
 
-Graphics::Surface Graphics::createSurface(const Buffer& data, const std::vector<Attrib>& attributes, const std::vector<GLuint>& indices)
+Graphics::Surface Graphics::createSurface(const Buffer& data, const std::vector<Attrib>& attributes, const std::vector<GLuint>& indices,
+                                          GLenum prim)
 {
     Surface surface = createSurface(data, attributes);
-
-    // Can copy from forwarded function, might be faster
+    surface.prim = prim;
 
     glGenBuffers(1, &surface.ibo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, surface.ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), &indices[0], GL_STATIC_DRAW);
     surface.num = indices.size();
 
+    // The largest short is kept free for primitive restart
+    if (data.num < 0xffff)
+    {
+        std::vector<GLushort> shorts(indices.size());
+        for (size_t i = 0; i < indices.size(); i++)
+            shorts[i] = indices[i] == RESTART_INDEX ? 0xffff : GLushort(indices[i]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * shorts.size(), shorts.data(), GL_STATIC_DRAW);
+        surface.indexType = GL_UNSIGNED_SHORT;
+    }
+    else
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+
     return surface;
 }
 
+std::vector<GLuint> Graphics::gridIndices(unsigned width, unsigned height)
+{
+    std::vector<GLuint> indices;
+    if (width < 2 || height < 2) return indices;
+    indices.reserve((width - 1) * (height - 1) * 6);
+    for (unsigned i = 0; i < height - 1; i++)
+    {
+        for (unsigned j = 0; j < width - 1; j++)
+        {
+            GLuint index = i*width + j;
+            indices.push_back(index);
+            indices.push_back(index + width);
+            indices.push_back(index + 1);
+
+            indices.push_back(index + 1);
+            indices.push_back(index + width);
+            indices.push_back(index + width + 1);
+        }
+    }
+    return indices;
+}
+
+GLuint Graphics::getAttribBytes(const Attrib& attrib)
+{
+    switch (attrib.type)
+    {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+        return attrib.size;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+    case GL_HALF_FLOAT:
+        return attrib.size * 2;
+    case GL_INT_2_10_10_10_REV:
+    case GL_UNSIGNED_INT_2_10_10_10_REV:
+        return 4;
+    case GL_DOUBLE:
+        return attrib.size * 8;
+    default:
+        return attrib.size * 4;
+    }
+}
+
+void Graphics::setVertexAttributes(const std::vector<Attrib>& attributes, size_t stride, GLuint first, GLuint divisor,
+                                   size_t base)
+{
+    GLuint offset = 0;
+    for (size_t i = 0; i < attributes.size(); i++)
+    {
+        const Attrib& attrib = attributes[i];
+        if (attrib.placed) offset = attrib.offset;
+        glEnableVertexAttribArray(first + i);
+        glVertexAttribPointer(first + i, attrib.size, attrib.type, attrib.normalized, stride, (const GLvoid*)(base + offset));
+        glVertexAttribDivisor(first + i, divisor);
+        offset += getAttribBytes(attrib);
+    }
+}
+
+namespace {
+    // Instanced when instances is non-zero
+    void draw(const Graphics::Surface& surface, GLsizei instances)
+    {
+        if (!surface.vao) return;
+        glBindVertexArray(surface.vao);
+        if (surface.ibo)
+        {
+            // Strips end at the largest index of their type
+            bool restart = surface.prim == GL_TRIANGLE_STRIP;
+            if (restart)
+            {
+                glEnable(GL_PRIMITIVE_RESTART);
+                glPrimitiveRestartIndex(surface.indexType == GL_UNSIGNED_SHORT ? 0xffff : RESTART_INDEX);
+            }
+            const GLvoid* offset = (const GLvoid*)surface.indexOffset;
+            if (instances)
+                glDrawElementsInstancedBaseVertex(surface.prim, surface.num, surface.indexType, offset, instances, surface.base);
+            else
+                glDrawElementsBaseVertex(surface.prim, surface.num, surface.indexType, offset, surface.base);
+            if (restart)
+                glDisable(GL_PRIMITIVE_RESTART);
+        }
+        else if (instances)
+            glDrawArraysInstanced(surface.prim, surface.base, surface.num, instances);
+        else
+            glDrawArrays(surface.prim, surface.base, surface.num);
+    }
+}
+
 void Graphics::drawSurface(const Surface& surface)
 {
-    if (!surface.vao) return;
+    draw(surface, 0);
+}
+
+void Graphics::drawSurfaceInstanced(const Surface& surface, GLsizei instances)
+{
+    if (instances > 0)
+        draw(surface, instances);
+}
+
+void Graphics::drawSurfaceInstanced(const InstancedSurface& surface)
+{
+    drawSurfaceInstanced(surface.surface, surface.count);
+}
+
+Graphics::InstancedSurface Graphics::createInstancedSurface(const Surface& surface, GLuint firstLocation,
+                                                            const std::vector<Attrib>& attributes, size_t stride, GLsizei capacity)
+{
+    InstancedSurface instanced = {surface, 0, capacity, 0, GLsizei(stride)};
+    glGenBuffers(1, &instanced.instances);
+    glBindBuffer(GL_ARRAY_BUFFER, instanced.instances);
+    glBufferData(GL_ARRAY_BUFFER, stride * capacity, nullptr, GL_STREAM_DRAW);
+
     glBindVertexArray(surface.vao);
-    if (surface.ibo)
-        glDrawElements(surface.prim, surface.num, GL_UNSIGNED_INT, 0);
-    else
-        glDrawArrays(surface.prim, 0, surface.num);
-    // unbind?
+    setVertexAttributes(attributes, stride, firstLocation, 1);
+    return instanced;
+}
+
+void Graphics::updateInstances(InstancedSurface& surface, const Buffer& instances)
+{
+    Testbed::assert(instances.num == 0 || instances.stride == size_t(surface.stride), "[Mesh] Instance size doesn't match the surface");
+    glBindBuffer(GL_ARRAY_BUFFER, surface.instances);
+    if (GLsizei(instances.num) > surface.capacity)
+    {
+        while (surface.capacity < GLsizei(instances.num))
+            surface.capacity = surface.capacity ? surface.capacity * 2 : 64;
+        glBufferData(GL_ARRAY_BUFFER, surface.capacity * surface.stride, nullptr, GL_STREAM_DRAW);
+    }
+
+    // The driver can hand out fresh memory while the last frame's instances are still being read
+    if (instances.size)
+    {
+        void* data = glMapBufferRange(GL_ARRAY_BUFFER, 0, instances.size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (!data)
+        {
+            // The old contents are gone either way, draw nothing rather than garbage
+            fprintf(stderr, "[Mesh] Failed to map instance buffer, skipping %zu instances\n", instances.num);
+            surface.count = 0;
+            return;
+        }
+        memcpy(data, instances.data, instances.size);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    surface.count = instances.num;
 }
 
 void Graphics::deleteSurface(Graphics::Surface& surface)
@@ -58,6 +198,17 @@ void Graphics::deleteSurface(Graphics::Surface& surface)
     surface.vao = 0;
     surface.ibo = 0;
     surface.num = 0;
+    surface.base = 0;
+    surface.indexOffset = 0;
+}
+
+void Graphics::deleteSurface(InstancedSurface& surface)
+{
+    deleteSurface(surface.surface);
+    glDeleteBuffers(1, &surface.instances);
+    surface.instances = 0;
+    surface.capacity = 0;
+    surface.count = 0;
 }
 
 // drawSurface bind vao, glDrawArrays(GL_TRIANGLES, 0, surface.num)
@@ -0,0 +1,244 @@
+#include "MeshOptimizer.hpp"
+#include <math.h>
+#include <algorithm>
+#include <stdint.h>
+#include <unordered_map>
+
+using namespace Graphics;
+
+namespace {
+    // Scoring from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+    const int CACHE_SIZE = 32;
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float LAST_TRI_SCORE = 0.75f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+
+    // Strips only take triangles this far ahead of the ones already in them,
+    // following an edge further would walk away from the cache order
+    const size_t STRIP_WINDOW = 32;
+
+    float vertexScore(int position, unsigned remaining)
+    {
+        if (remaining == 0) return -1.0f;
+        float score = 0.0f;
+        if (position >= 0)
+        {
+            // The last triangle's vertices score the same, so no strip-like order is forced
+            if (position < 3)
+                score = LAST_TRI_SCORE;
+            else
+                score = powf(1.0f - float(position - 3) / (CACHE_SIZE - 3), CACHE_DECAY_POWER);
+        }
+        // Vertices with few triangles left are worth finishing off
+        return score + VALENCE_BOOST_SCALE * powf(float(remaining), -VALENCE_BOOST_POWER);
+    }
+
+    uint64_t edgeKey(GLuint a, GLuint b)
+    {
+        return (uint64_t(a) << 32) | b;
+    }
+}
+
+CacheStats Graphics::analyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, bool strip, unsigned cacheSize)
+{
+    // A vertex is cached if fewer than cacheSize misses happened since it was loaded
+    std::vector<size_t> loaded(vertexCount, 0);
+    std::vector<bool> seen(vertexCount, false);
+    size_t misses = 0;
+    size_t used = 0;
+    size_t run = 0;
+    CacheStats stats = {0, 0.0, 0.0};
+
+    for (GLuint index : indices)
+    {
+        if (index == RESTART_INDEX)
+        {
+            run = 0;
+            continue;
+        }
+        if (strip ? ++run >= 3 : ++run % 3 == 0)
+            stats.triangles++;
+        if (!seen[index] || misses - loaded[index] >= cacheSize)
+        {
+            used += !seen[index];
+            seen[index] = true;
+            loaded[index] = ++misses;
+        }
+    }
+
+    if (stats.triangles) stats.acmr = double(misses) / stats.triangles;
+    if (used) stats.atvr = double(misses) / used;
+    return stats;
+}
+
+void Graphics::optimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount)
+{
+    size_t triangles = indices.size() / 3;
+    if (triangles == 0) return;
+
+    // Triangles of every vertex, the first remaining[v] of them not yet emitted
+    std::vector<unsigned> remaining(vertexCount, 0);
+    for (size_t i = 0; i < triangles * 3; i++)
+        remaining[indices[i]]++;
+    std::vector<unsigned> first(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        first[v + 1] = first[v] + remaining[v];
+    std::vector<unsigned> adjacency(triangles * 3);
+    std::vector<unsigned> filled(first.begin(), first.end() - 1);
+    for (size_t i = 0; i < triangles * 3; i++)
+        adjacency[filled[indices[i]]++] = i / 3;
+
+    std::vector<int> position(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore(-1, remaining[v]);
+    std::vector<float> triangleScore(triangles);
+    std::vector<bool> emitted(triangles, false);
+    int best = 0;
+    for (size_t t = 0; t < triangles; t++)
+    {
+        triangleScore[t] = score[indices[t*3]] + score[indices[t*3 + 1]] + score[indices[t*3 + 2]];
+        if (triangleScore[t] > triangleScore[best]) best = t;
+    }
+
+    std::vector<GLuint> result;
+    result.reserve(triangles * 3);
+    std::vector<GLuint> cache, next;
+    size_t scan = 0;
+    while (result.size() < triangles * 3)
+    {
+        // Nothing in the cache has triangles left, take the next one in input order
+        if (best < 0)
+        {
+            while (emitted[scan]) scan++;
+            best = scan;
+        }
+
+        emitted[best] = true;
+        next.clear();
+        for (int k = 0; k < 3; k++)
+        {
+            GLuint v = indices[best*3 + k];
+            result.push_back(v);
+            next.push_back(v);
+
+            // Swap the triangle out of the remaining part of the list
+            unsigned* list = &adjacency[first[v]];
+            for (unsigned i = 0; i < remaining[v]; i++)
+            {
+                if (list[i] != unsigned(best)) continue;
+                std::swap(list[i], list[remaining[v] - 1]);
+                break;
+            }
+            remaining[v]--;
+        }
+
+        // Newest vertices go to the front, the rest keep their order
+        for (GLuint v : cache)
+            if (v != next[0] && v != next[1] && v != next[2])
+                next.push_back(v);
+        for (size_t i = 0; i < next.size(); i++)
+            position[next[i]] = i < size_t(CACHE_SIZE) ? int(i) : -1;
+        for (GLuint v : next)
+            score[v] = vertexScore(position[v], remaining[v]);
+        if (next.size() > size_t(CACHE_SIZE))
+            next.resize(CACHE_SIZE);
+        cache.swap(next);
+
+        // Only triangles touching the cache changed score, the best is among them
+        best = -1;
+        float bestScore = -1.0f;
+        for (GLuint v : cache)
+        {
+            for (unsigned i = 0; i < remaining[v]; i++)
+            {
+                unsigned t = adjacency[first[v] + i];
+                float s = score[indices[t*3]] + score[indices[t*3 + 1]] + score[indices[t*3 + 2]];
+                triangleScore[t] = s;
+                if (s > bestScore)
+                {
+                    bestScore = s;
+                    best = t;
+                }
+            }
+        }
+    }
+    indices.swap(result);
+}
+
+std::vector<GLuint> Graphics::optimizeVertexFetch(std::vector<GLuint>& indices, size_t vertexCount)
+{
+    std::vector<GLuint> remap(vertexCount, RESTART_INDEX);
+    GLuint count = 0;
+    for (GLuint& index : indices)
+    {
+        if (index == RESTART_INDEX) continue;
+        if (remap[index] == RESTART_INDEX)
+            remap[index] = count++;
+        index = remap[index];
+    }
+    return remap;
+}
+
+std::vector<GLuint> Graphics::stripify(const std::vector<GLuint>& indices)
+{
+    size_t triangles = indices.size() / 3;
+    std::unordered_multimap<uint64_t, unsigned> edges;
+    edges.reserve(triangles * 3);
+    for (size_t t = 0; t < triangles; t++)
+        for (int k = 0; k < 3; k++)
+            edges.insert({edgeKey(indices[t*3 + k], indices[t*3 + (k + 1) % 3]), unsigned(t)});
+
+    std::vector<bool> used(triangles, false);
+    size_t limit = 0;
+    // Unused triangle with the directed edge a to b, or -1
+    auto neighbor = [&](GLuint a, GLuint b) {
+        auto range = edges.equal_range(edgeKey(a, b));
+        for (auto it = range.first; it != range.second; ++it)
+            if (!used[it->second] && it->second <= limit) return int(it->second);
+        return -1;
+    };
+
+    std::vector<GLuint> strip;
+    strip.reserve(indices.size());
+    for (size_t t = 0; t < triangles; t++)
+    {
+        if (used[t]) continue;
+        limit = t + STRIP_WINDOW;
+        const GLuint* v = &indices[t*3];
+
+        // Start with the rotation whose last edge has a neighbor to continue to
+        int start = 0;
+        for (int r = 0; r < 3; r++)
+        {
+            if (neighbor(v[(r + 2) % 3], v[(r + 1) % 3]) >= 0)
+            {
+                start = r;
+                break;
+            }
+        }
+
+        if (!strip.empty()) strip.push_back(RESTART_INDEX);
+        for (int k = 0; k < 3; k++)
+            strip.push_back(v[(start + k) % 3]);
+        used[t] = true;
+
+        // Odd triangles of a strip are wound backwards, so they continue across the reversed edge
+        for (unsigned k = 1; ; k++)
+        {
+            GLuint a = strip[strip.size() - 2];
+            GLuint b = strip[strip.size() - 1];
+            int n = k & 1 ? neighbor(b, a) : neighbor(a, b);
+            if (n < 0) break;
+            used[n] = true;
+            limit = std::max(limit, n + STRIP_WINDOW);
+            const GLuint* w = &indices[n*3];
+            GLuint c = w[0];
+            for (int i = 1; i < 3; i++)
+                if (w[i] != a && w[i] != b) c = w[i];
+            strip.push_back(c);
+        }
+    }
+    return strip;
+}
@@ -1,6 +1,8 @@
 #include "Models.hpp"
 #include "Shader.hpp"
 #include "Graphics.hpp"
+#include "Mesh.hpp"
+#include "MeshOptimizer.hpp"
 #include <glm/glm.hpp>
 
 enum Model { SCENERY=0, TERRAIN=1, OCEAN=2, NUM, UNIFORM=6 };
@@ -74,11 +76,13 @@ void Models::initialize()
     GLuint oceanVS = Graphics::loadShader("res/ocean.vert", GL_VERTEX_SHADER);
     GLuint phongFS = Graphics::loadShader("res/phong.frag", GL_FRAGMENT_SHADER);
     GLuint oceanFS = Graphics::loadShader("res/ocean.frag", GL_FRAGMENT_SHADER);
+    GLuint gbufferFS = Graphics::loadShader("res/gbuffer.frag", GL_FRAGMENT_SHADER);
+    GLuint ssrFS = Graphics::loadShader("res/ssr.frag", GL_FRAGMENT_SHADER, {"res/hiz_trace.glsl"});
     
     // Create programs
-    shaders[SCENERY] = Graphics::createProgram({sceneryVS, phongFS});
-    shaders[TERRAIN] = Graphics::createProgram({terrainVS, phongFS});
-    shaders[OCEAN] = Graphics::createProgram({oceanVS, oceanFS});
+    shaders[SCENERY] = Graphics::createProgram({sceneryVS, phongFS, gbufferFS});
+    shaders[TERRAIN] = Graphics::createProgram({terrainVS, phongFS, gbufferFS});
+    shaders[OCEAN] = Graphics::createProgram({oceanVS, oceanFS, ssrFS, gbufferFS});
 
     // Release shaders
     glDeleteShader(sceneryVS);
@@ -86,6 +90,8 @@ void Models::initialize()
     glDeleteShader(oceanVS);
     glDeleteShader(phongFS);
     glDeleteShader(oceanVS);
+    glDeleteShader(gbufferFS);
+    glDeleteShader(ssrFS);
 
     // Create uniform buffers
     glBindBuffer(GL_UNIFORM_BUFFER, buffers[UNIFORM]);
@@ -156,34 +162,19 @@ void buildScenery() {}
 void buildTerrain()
 {
     glm::vec2 vertices[41*41]; int arrayIndex = 0;
-    GLuint indices[40*40*2*3];
    
     for (float y = -20.0f; y <= 20.0f; y += 1.0f)
         for (float x = -20.0f; x <= 20.0f; x += 1.0f)
             vertices[arrayIndex++] = glm::vec2(x, y);
 
-    arrayIndex = 0;
-    for (unsigned i = 0; i < 40; i++)
-    {
-        for (unsigned j = 0; j < 40; j++)
-        {
-            const unsigned width = 41;
-            GLuint index = i*width + j;
-            indices[arrayIndex++] = index;
-            indices[arrayIndex++] = index + width;
-            indices[arrayIndex++] = index + 1;
-            
-            indices[arrayIndex++] = index + 1;
-            indices[arrayIndex++] = index + width;
-            indices[arrayIndex++] = index + width + 1;
-        }
-    }
+    std::vector<GLuint> indices = Graphics::gridIndices(41, 41);
+    Graphics::optimizeVertexCache(indices, 41*41);
 
     glBindBuffer(GL_ARRAY_BUFFER, buffers[SCENERY]);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[SCENERY*2]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-    numIndices[TERRAIN] = sizeof(indices) / sizeof(GLuint);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+    numIndices[TERRAIN] = indices.size();
 }
 
 void buildOcean()
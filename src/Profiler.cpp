@@ -0,0 +1,217 @@
+#include "Profiler.hpp"
+#include "Testbed.hpp"
+#include <stdio.h>
+#include <map>
+#include <deque>
+#include <string>
+
+using namespace Graphics;
+
+// Zones are timed with GL_TIMESTAMP counters so they can nest, which
+// GL_TIME_ELAPSED queries cannot. Results are read FRAMES frames later and
+// only if the driver reports them available, so the CPU never waits on them.
+
+namespace {
+    const int FRAMES = 4;   // Frames in flight before a result is read back
+    const int WINDOW = 64;  // Samples kept per zone for min/avg/max
+
+    struct Zone
+    {
+        std::string name;
+        int depth;
+        double samples[WINDOW];
+        int count;  // Total samples recorded
+        double total;   // Sum of all count samples
+    };
+
+    struct Marker
+    {
+        int zone;
+        GLuint begin;
+        GLuint end;
+    };
+
+    struct Frame
+    {
+        std::vector<GLuint> queries;   // Pool, grows to the most zones seen in a frame
+        size_t used;
+        std::vector<Marker> markers;
+        bool pending;
+    };
+
+    Frame frames[FRAMES];
+    int current = 0;
+    bool active = false;
+    std::deque<Zone> zones;    // Appending keeps the names ZoneStats points at in place
+    std::map<std::string, int> zoneIndices;
+    std::vector<size_t> stack;  // Open markers in the current frame
+    unsigned dropped = 0;
+
+    GLuint nextQuery(Frame& frame)
+    {
+        if (frame.used == frame.queries.size())
+        {
+            GLuint query;
+            glGenQueries(1, &query);
+            frame.queries.push_back(query);
+        }
+        return frame.queries[frame.used++];
+    }
+
+    int findZone(const char* name)
+    {
+        auto it = zoneIndices.find(name);
+        if (it != zoneIndices.end()) return it->second;
+        Zone zone;
+        zone.name = name;
+        zone.depth = stack.size();
+        zone.count = 0;
+        zone.total = 0.0;
+        zones.push_back(zone);
+        zoneIndices[name] = zones.size() - 1;
+        return zones.size() - 1;
+    }
+
+    void collect(Frame& frame)
+    {
+        if (!frame.pending) return;
+        frame.pending = false;
+        if (frame.used == 0) return;
+
+        // Queries complete in order, so the last one covers the whole frame
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            dropped++;
+            return;
+        }
+
+        // Zones used more than once in a frame accumulate
+        std::map<int, double> totals;
+        for (const Marker& marker : frame.markers)
+        {
+            GLuint64 begin, end;
+            glGetQueryObjectui64v(marker.begin, GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(marker.end, GL_QUERY_RESULT, &end);
+            totals[marker.zone] += (end - begin) / 1000000.0;
+        }
+        for (auto& total : totals)
+        {
+            Zone& zone = zones[total.first];
+            zone.samples[zone.count % WINDOW] = total.second;
+            zone.total += total.second;
+            zone.count++;
+        }
+    }
+}
+
+void Profiler::initialize()
+{
+    printf("[Profiler] Initializing %d frame query ring\n", FRAMES);
+    for (Frame& frame : frames)
+    {
+        frame.used = 0;
+        frame.pending = false;
+        frame.markers.clear();
+    }
+    current = 0;
+    active = false;
+}
+
+void Profiler::beginFrame()
+{
+    current = (current + 1) % FRAMES;
+    Frame& frame = frames[current];
+    collect(frame);
+    frame.used = 0;
+    frame.markers.clear();
+    stack.clear();
+    active = true;
+}
+
+void Profiler::endFrame()
+{
+    Testbed::assert(stack.empty(), "[Profiler] Unbalanced zones at end of frame");
+    frames[current].pending = true;
+    active = false;
+}
+
+void Profiler::begin(const char* name)
+{
+    if (!active) return;
+    Frame& frame = frames[current];
+    Marker marker = {findZone(name), nextQuery(frame), 0};
+    glQueryCounter(marker.begin, GL_TIMESTAMP);
+    stack.push_back(frame.markers.size());
+    frame.markers.push_back(marker);
+}
+
+void Profiler::end()
+{
+    if (!active || stack.empty()) return;
+    Frame& frame = frames[current];
+    Marker& marker = frame.markers[stack.back()];
+    stack.pop_back();
+    marker.end = nextQuery(frame);
+    glQueryCounter(marker.end, GL_TIMESTAMP);
+}
+
+std::vector<Profiler::ZoneStats> Profiler::getStats()
+{
+    std::vector<ZoneStats> stats;
+    stats.reserve(zones.size());
+    for (const Zone& zone : zones)
+    {
+        ZoneStats s = {zone.name.c_str(), zone.depth, 0.0, 0.0, 0.0, 0, 0.0, zone.count};
+        s.samples = zone.count < WINDOW ? zone.count : WINDOW;
+        for (int i = 0; i < s.samples; i++)
+        {
+            double t = zone.samples[i];
+            if (i == 0 || t < s.min) s.min = t;
+            if (i == 0 || t > s.max) s.max = t;
+            s.avg += t;
+        }
+        if (s.samples) s.avg /= s.samples;
+        if (zone.count) s.mean = zone.total / zone.count;
+        stats.push_back(s);
+    }
+    return stats;
+}
+
+void Profiler::reset()
+{
+    for (Zone& zone : zones)
+    {
+        zone.count = 0;
+        zone.total = 0.0;
+    }
+    dropped = 0;
+}
+
+void Profiler::print()
+{
+    for (const ZoneStats& s : getStats())
+        printf("[Profiler] %*s%-*s min %7.3fms  avg %7.3fms  max %7.3fms\n",
+               2 * s.depth, "", 16 - 2 * s.depth, s.name, s.min, s.avg, s.max);
+    if (dropped)
+        printf("[Profiler] %u frames dropped waiting on queries\n", dropped);
+}
+
+void Profiler::shutdown()
+{
+    printf("[Profiler] Shutting down\n");
+    for (Frame& frame : frames)
+    {
+        if (!frame.queries.empty())
+            glDeleteQueries(frame.queries.size(), &frame.queries[0]);
+        frame.queries.clear();
+        frame.markers.clear();
+        frame.used = 0;
+        frame.pending = false;
+    }
+    zones.clear();
+    zoneIndices.clear();
+    stack.clear();
+    active = false;
+}
@@ -0,0 +1,269 @@
+#include "RenderGraph.hpp"
+#include "Profiler.hpp"
+#include "Testbed.hpp"
+#include <stdio.h>
+#include <algorithm>
+
+namespace {
+    const GLuint UNKNOWN = GLuint(-1);
+
+    GLuint firstTexture(RenderTarget& target)
+    {
+        return target.getNumTextures() ? target.getTexture(0) : 0;
+    }
+}
+
+//============================================================================//
+// Declaration                                                                //
+//============================================================================//
+
+void RenderGraph::Builder::sample(Resource resource, GLuint unit, int attachment, bool mips)
+{
+    graph.passes[pass].reads.push_back({resource, attachment, int(unit), mips});
+}
+
+void RenderGraph::Builder::read(Resource resource, int attachment)
+{
+    graph.passes[pass].reads.push_back({resource, attachment, -1, false});
+}
+
+void RenderGraph::Builder::write(Resource resource)
+{
+    Testbed::assert(graph.passes[pass].write < 0, "[RenderGraph] A pass can only write one target");
+    graph.passes[pass].write = resource;
+}
+
+void RenderGraph::Builder::sideEffect()
+{
+    graph.passes[pass].sideEffect = true;
+}
+
+RenderGraph::Resource RenderGraph::create(const char* name, const RenderTarget::Desc& desc)
+{
+    entries.push_back({name, RenderTarget::resolve(desc), nullptr, false, -1, -1, -1, ~0u});
+    return entries.size() - 1;
+}
+
+RenderGraph::Resource RenderGraph::import(const char* name, RenderTarget& target, bool output)
+{
+    unsigned dirtyMips = ~0u;
+    auto it = importedMips.find(&target);
+    if (it != importedMips.end() && it->second.texture == firstTexture(target))
+        dirtyMips = it->second.dirtyMips;
+    entries.push_back({name, target.getDesc(), &target, output, -1, -1, -1, dirtyMips});
+    return entries.size() - 1;
+}
+
+void RenderGraph::markWritten(RenderTarget& target)
+{
+    importedMips.erase(&target);
+    for (Entry& entry : entries)
+        if (entry.imported == &target)
+            entry.dirtyMips = ~0u;
+}
+
+void RenderGraph::addPass(const char* name, Setup setup, Execute execute)
+{
+    passes.push_back({name, execute, {}, -1, false, false, false, 0});
+    Builder builder(*this, passes.size() - 1);
+    setup(builder);
+}
+
+void RenderGraph::addBlit(const char* name, Resource src, Resource dst, GLbitfield mask)
+{
+    passes.push_back({name, nullptr, {{src, 0, -1, false}}, dst, false, false, true, mask});
+}
+
+//============================================================================//
+// Compilation                                                                //
+//============================================================================//
+
+void RenderGraph::compile()
+{
+    // Walk backwards from the outputs, a pass lives if a later live pass reads what it writes
+    std::vector<bool> needed(entries.size(), false);
+    for (int i = passes.size() - 1; i >= 0; i--)
+    {
+        Pass& pass = passes[i];
+        pass.alive = pass.sideEffect;
+        if (pass.write >= 0)
+        {
+            const Entry& target = entries[pass.write];
+            pass.alive = pass.alive || target.output || needed[pass.write];
+        }
+        if (!pass.alive) continue;
+        for (const Read& read : pass.reads)
+            needed[read.resource] = true;
+    }
+
+    // Lifetimes over the live passes
+    for (size_t i = 0; i < passes.size(); i++)
+    {
+        const Pass& pass = passes[i];
+        if (!pass.alive) continue;
+        auto use = [&](Resource resource) {
+            Entry& entry = entries[resource];
+            if (entry.first < 0) entry.first = i;
+            entry.last = i;
+        };
+        for (const Read& read : pass.reads)
+            use(read.resource);
+        if (pass.write >= 0)
+            use(pass.write);
+    }
+
+    // Hand out physical targets in pass order, reusing any whose previous
+    // occupant is done by the time the next one starts
+    for (Physical& target : physical)
+        target.busyUntil = -1;
+    std::vector<int> order;
+    for (size_t i = 0; i < entries.size(); i++)
+        if (!entries[i].imported && entries[i].first >= 0)
+            order.push_back(i);
+    std::sort(order.begin(), order.end(), [this](int a, int b) { return entries[a].first < entries[b].first; });
+    for (int index : order)
+    {
+        Entry& entry = entries[index];
+        for (size_t i = 0; i < physical.size() && entry.physical < 0; i++)
+        {
+            if (physical[i].busyUntil < entry.first && physical[i].target.getDesc() == entry.desc)
+                entry.physical = i;
+        }
+        if (entry.physical < 0)
+        {
+            printf("[RenderGraph] Allocating %s\n", entry.name);
+            physical.push_back({RenderTarget::create(entry.desc), frame, -1});
+            entry.physical = physical.size() - 1;
+        }
+        physical[entry.physical].busyUntil = entry.last;
+        physical[entry.physical].frame = frame;
+    }
+}
+
+//============================================================================//
+// Execution                                                                  //
+//============================================================================//
+
+RenderTarget& RenderGraph::getTarget(Resource resource)
+{
+    Entry& entry = entries[resource];
+    if (entry.imported) return *entry.imported;
+    return physical[entry.physical].target;
+}
+
+GLuint RenderGraph::getTexture(const Entry& entry, int attachment)
+{
+    RenderTarget& target = entry.imported ? *entry.imported : physical[entry.physical].target;
+    return attachment == DEPTH ? target.getDepthTexture() : target.getTexture(attachment);
+}
+
+void RenderGraph::bind(GLuint unit, GLuint texture)
+{
+    if (unit >= bound.size())
+        bound.resize(unit + 1, UNKNOWN);
+    if (bound[unit] == texture) return;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    bound[unit] = texture;
+}
+
+void RenderGraph::execute()
+{
+    compile();
+
+    // Bindings made outside the graph are unknown
+    bound.assign(bound.size(), UNKNOWN);
+    for (size_t i = 0; i < passes.size(); i++)
+    {
+        Pass& pass = passes[i];
+        if (!pass.alive) continue;
+        Graphics::ProfileZone zone(pass.name);
+
+        for (const Read& read : pass.reads)
+        {
+            Entry& entry = entries[read.resource];
+            GLuint texture = getTexture(entry, read.attachment);
+            // Depth textures have a single level
+            unsigned bit = read.attachment == DEPTH ? 0 : 1u << read.attachment;
+            if (read.mips && (entry.dirtyMips & bit) && getTarget(read.resource).getLevels() > 1)
+            {
+                // bind() skips a cached binding, which leaves the active unit wherever it was
+                bind(0, texture);
+                glActiveTexture(GL_TEXTURE0);
+                glGenerateMipmap(GL_TEXTURE_2D);
+                entry.dirtyMips &= ~bit;
+            }
+            if (read.unit >= 0)
+                bind(read.unit, texture);
+        }
+        glActiveTexture(GL_TEXTURE0);
+
+        if (pass.write >= 0)
+            entries[pass.write].dirtyMips = ~0u;
+        if (pass.blit)
+        {
+            RenderTarget& dst = getTarget(pass.write);
+            int width = dst.getWidth() ? dst.getWidth() : Testbed::getScreenWidth();
+            int height = dst.getHeight() ? dst.getHeight() : Testbed::getScreenHeight();
+            dst.blit(getTarget(pass.reads[0].resource), width, height, pass.mask);
+            continue;
+        }
+
+        if (pass.write >= 0)
+        {
+            RenderTarget& target = getTarget(pass.write);
+            target.activate();
+            if (target.getWidth())
+                glViewport(0, 0, target.getWidth(), target.getHeight());
+            else
+                glViewport(0, 0, Testbed::getScreenWidth(), Testbed::getScreenHeight());
+        }
+        pass.execute();
+        bound.assign(bound.size(), UNKNOWN);
+    }
+
+    // Targets not imported this frame start dirty when they come back
+    importedMips.clear();
+    for (const Entry& entry : entries)
+    {
+        if (!entry.imported) continue;
+        MipState state = {firstTexture(*entry.imported), entry.dirtyMips};
+        auto inserted = importedMips.insert({entry.imported, state});
+        if (!inserted.second)
+            inserted.first->second.dirtyMips |= entry.dirtyMips;   // Imported twice, keep the dirtier
+    }
+
+    lastFrame.clear();
+    for (const Pass& pass : passes)
+        lastFrame.push_back({pass.name, pass.alive});
+    passes.clear();
+    entries.clear();
+
+    // Targets nobody has asked for in a while, e.g. after a resize
+    frame++;
+    for (size_t i = 0; i < physical.size(); )
+    {
+        if (frame - physical[i].frame > maxIdleFrames)
+        {
+            if (i + 1 < physical.size())
+                physical[i] = std::move(physical.back());
+            physical.pop_back();
+        }
+        else i++;
+    }
+}
+
+void RenderGraph::print() const
+{
+    printf("[RenderGraph] %zu passes, %zu targets\n", lastFrame.size(), physical.size());
+    for (const Report& pass : lastFrame)
+        printf("\t%s%s\n", pass.name, pass.alive ? "" : " (dropped)");
+}
+
+void RenderGraph::release()
+{
+    passes.clear();
+    entries.clear();
+    physical.clear();
+    importedMips.clear();
+}
@@ -1,49 +1,129 @@
 #include "RenderTarget.hpp"
 #include "Testbed.hpp"
+#include <algorithm>
 
-RenderTarget RenderTarget::create(GLuint width, GLuint height, int num, bool hasDepth)
+namespace {
+    GLuint activeTarget = 0;    // Framebuffer last bound through activate or blit
+}
+
+bool RenderTarget::Desc::operator==(const Desc& other) const
+{
+    return width == other.width && height == other.height && color == other.color &&
+           levels == other.levels && depth == other.depth &&
+           depthRenderbuffer == other.depthRenderbuffer && samples == other.samples;
+}
+
+RenderTarget::Desc RenderTarget::resolve(Desc desc)
+{
+    int levels = 1;
+    while ((std::max(desc.width, desc.height) >> levels) > 0)
+        levels++;
+    if (desc.samples > 0)
+        desc.levels = 1;
+    else if (desc.levels <= 0 || desc.levels > levels)
+        desc.levels = levels;
+    if (desc.depth == GL_NONE)
+        desc.depthRenderbuffer = false;
+    return desc;
+}
+
+RenderTarget RenderTarget::create(const Desc& description)
 {
     RenderTarget target;
+    Desc& desc = target.desc;
+    desc = resolve(description);
+    GLenum textureType = desc.samples > 0 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
 
     glGenFramebuffers(1, &target.handle);
     glBindFramebuffer(GL_FRAMEBUFFER, target.handle);
-    printf("Creating framebuffer %u\n", target.handle);
+    printf("Creating framebuffer %u (%ux%u, %d levels, %d samples)\n", target.handle,
+           desc.width, desc.height, desc.levels, desc.samples);
     
     // Add attachments
+    int num = desc.color.size();
     if (num > 0)
     {
+        std::vector<GLenum> drawBuffers(num);
         target.textures.resize(num);
         glGenTextures(num, &target.textures[0]);
         for (int i = 0; i < num; i++)
         {
-            glBindTexture(GL_TEXTURE_2D, target.textures[i]);
-        //    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
-            glTexStorage2D(GL_TEXTURE_2D, 10, GL_RGB8, width, height);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0+i, GL_TEXTURE_2D, target.textures[i], 0);
+            glBindTexture(textureType, target.textures[i]);
+            if (desc.samples > 0)
+            {
+                glTexImage2DMultisample(textureType, desc.samples, desc.color[i], desc.width, desc.height, GL_TRUE);
+            }
+            else
+            {
+                glTexStorage2D(textureType, desc.levels, desc.color[i], desc.width, desc.height);
+                glTexParameteri(textureType, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(textureType, GL_TEXTURE_MIN_FILTER, desc.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+            }
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0+i, textureType, target.textures[i], 0);
+            drawBuffers[i] = GL_COLOR_ATTACHMENT0+i;
             printf("\tColor Attachment %d: %u\n", i, target.textures[i]);
         }
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(textureType, 0);
+        glDrawBuffers(num, &drawBuffers[0]);
+    }
+    else
+    {
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
     }
 
-    if (hasDepth)
+    if (desc.depth != GL_NONE)
     {
-        glGenTextures(1, &target.depth);
-        glBindTexture(GL_TEXTURE_2D, target.depth);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT, target.depth, 0);
-        printf("\tDepth Attachment: %u\n", target.depth);
+        bool stencil = desc.depth == GL_DEPTH24_STENCIL8 || desc.depth == GL_DEPTH32F_STENCIL8;
+        GLenum attachment = stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+        if (desc.depthRenderbuffer)
+        {
+            // Never sampled, so the driver is free to keep it compressed
+            glGenRenderbuffers(1, &target.depth);
+            glBindRenderbuffer(GL_RENDERBUFFER, target.depth);
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, desc.samples, desc.depth, desc.width, desc.height);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, target.depth);
+            printf("\tDepth Renderbuffer: %u\n", target.depth);
+        }
+        else
+        {
+            glGenTextures(1, &target.depth);
+            glBindTexture(textureType, target.depth);
+            if (desc.samples > 0)
+            {
+                glTexImage2DMultisample(textureType, desc.samples, desc.depth, desc.width, desc.height, GL_TRUE);
+            }
+            else
+            {
+                glTexStorage2D(textureType, 1, desc.depth, desc.width, desc.height);
+                glTexParameteri(textureType, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                // Only level 0 exists, a mipmap filter would leave the texture incomplete
+                glTexParameteri(textureType, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(textureType, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(textureType, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            }
+            glBindTexture(textureType, 0);
+            glFramebufferTexture(GL_FRAMEBUFFER, attachment, target.depth, 0);
+            printf("\tDepth Attachment: %u\n", target.depth);
+        }
     }
 
     Testbed::assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "Failed to create FBO");
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    return std::move(target);
+    activeTarget = 0;
+    return target;
+}
+
+RenderTarget RenderTarget::create(GLuint width, GLuint height, int num, bool hasDepth, GLenum format)
+{
+    Desc desc;
+    desc.width = width;
+    desc.height = height;
+    desc.color.assign(num, format);
+    desc.depth = hasDepth ? GL_DEPTH_COMPONENT32 : GL_NONE;
+    return create(desc);
 }
 
 RenderTarget::RenderTarget(RenderTarget&& rt)
@@ -51,8 +131,11 @@ RenderTarget::RenderTarget(RenderTarget&& rt)
     handle = rt.handle;
     rt.handle = 0;
     textures = std::move(rt.textures);
+    rt.textures.clear();
     depth = rt.depth;
     rt.depth = 0;
+    desc = rt.desc;
+    rt.desc = Desc();   // Moved-from targets report no size, so pools reject them
 }
 
 RenderTarget& RenderTarget::operator=(RenderTarget&& rt)
@@ -61,8 +144,11 @@ RenderTarget& RenderTarget::operator=(RenderTarget&& rt)
     handle = rt.handle;
     rt.handle = 0;
     textures = std::move(rt.textures);
+    rt.textures.clear();
     depth = rt.depth;
     rt.depth = 0;
+    desc = rt.desc;
+    rt.desc = Desc();   // Moved-from targets report no size, so pools reject them
     return *this;
 }
 
@@ -72,33 +158,118 @@ void RenderTarget::clear()
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
-void RenderTarget::blit(const RenderTarget& src, int width, int height)
+void RenderTarget::bindRead(int attachment) const
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, handle);
+    glReadBuffer(handle ? GL_COLOR_ATTACHMENT0 + attachment : GL_BACK);
+}
+
+void RenderTarget::blit(const RenderTarget& src, int width, int height, GLbitfield mask)
 {
+    int srcWidth = src.desc.width ? src.desc.width : width;
+    int srcHeight = src.desc.height ? src.desc.height : height;
+    GLenum filter = (mask & GL_DEPTH_BUFFER_BIT) || (srcWidth == width && srcHeight == height) ? GL_NEAREST : GL_LINEAR;
     glBindFramebuffer(GL_READ_FRAMEBUFFER, src.handle);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, handle);
-    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, 
-                    GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBlitFramebuffer(0, 0, srcWidth, srcHeight, 0, 0, width, height, mask, filter);
+    activeTarget = handle;
 }
 
 void RenderTarget::activate() const
 {
-    static GLuint active = 0;
-    if (active != handle)
+    if (activeTarget != handle)
     {
         glBindFramebuffer(GL_FRAMEBUFFER, handle);
-        active = handle;
+        activeTarget = handle;
     }
 }
 
+void RenderTarget::setLevel(int level)
+{
+    activate();
+    for (size_t i = 0; i < textures.size(); i++)
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0+i, GL_TEXTURE_2D, textures[i], level);
+    glViewport(0, 0, std::max(desc.width >> level, 1u), std::max(desc.height >> level, 1u));
+}
+
 void RenderTarget::release()
 {
     if (textures.size() > 0)
         glDeleteTextures(textures.size(), &textures[0]);
     textures.clear();
-    if (depth)
+    // Depth is a texture unless asked for as a renderbuffer
+    if (depth && desc.depthRenderbuffer)
         glDeleteRenderbuffers(1, &depth);
+    else if (depth)
+        glDeleteTextures(1, &depth);
     depth = 0;
     if (handle)
         glDeleteFramebuffers(1, &handle);
+    // The name may be handed out again, don't let activate skip binding it
+    if (handle && activeTarget == handle)
+        activeTarget = 0;
     handle = 0;
 }
+
+//============================================================================//
+// Render target pool                                                         //
+//============================================================================//
+
+namespace {
+    bool isSignaled(GLsync fence)
+    {
+        GLint status = GL_UNSIGNALED;
+        glGetSynciv(fence, GL_SYNC_STATUS, 1, nullptr, &status);
+        return status == GL_SIGNALED;
+    }
+}
+
+RenderTarget RenderTargetPool::acquire(const RenderTarget::Desc& desc)
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        Entry& entry = entries[i];
+        if (!(entry.target.getDesc() == RenderTarget::resolve(desc)))
+            continue;
+        if (!isSignaled(entry.fence))
+            continue;
+
+        RenderTarget target = std::move(entry.target);
+        glDeleteSync(entry.fence);
+        if (i + 1 < entries.size())
+            entries[i] = std::move(entries.back());
+        entries.pop_back();
+        return target;
+    }
+    return RenderTarget::create(desc);
+}
+
+void RenderTargetPool::recycle(RenderTarget&& target)
+{
+    if (!target.isValid() || !target.getWidth()) return;
+    entries.push_back({std::move(target), glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), frame});
+}
+
+void RenderTargetPool::update()
+{
+    frame++;
+    for (size_t i = 0; i < entries.size(); )
+    {
+        // GL defers the delete if the GPU is still using it
+        if (frame - entries[i].frame > maxIdleFrames)
+        {
+            glDeleteSync(entries[i].fence);
+            if (i + 1 < entries.size())
+                entries[i] = std::move(entries.back());
+            entries.pop_back();
+        }
+        else i++;
+    }
+}
+
+void RenderTargetPool::clear()
+{
+    for (Entry& entry : entries)
+        glDeleteSync(entry.fence);
+    entries.clear();
+}
@@ -1,28 +1,63 @@
 #include "Shader.hpp"
 #include <stdio.h>
 #include <vector>
+#include <string>
 #include <glm/glm.hpp>
 
-GLuint Graphics::loadShader(const char* filename, GLenum type)
-{
-    printf("Loading shader: %s\n", filename);
-    FILE* file = fopen(filename, "rb");
-    if (!file)
+namespace {
+    bool readSource(const char* filename, std::string& source)
     {
-        perror(filename);
-        return 0;
+        FILE* file = fopen(filename, "rb");
+        if (!file)
+        {
+            perror(filename);
+            return false;
+        }
+
+        fseek(file, 0, SEEK_END);
+        size_t size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+
+        source.resize(size);
+        fread(&source[0], 1, size, file);
+        fclose(file);
+        return true;
     }
 
-    fseek(file, 0, SEEK_END);
-    size_t size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    // Length of the #version line including its newline, 0 without one
+    size_t versionLength(const std::string& source)
+    {
+        if (source.compare(0, 8, "#version") != 0) return 0;
+        size_t end = source.find('\n');
+        return end == std::string::npos ? source.size() : end + 1;
+    }
+}
 
-    std::vector<GLchar> source(size + 1);
-    fread(source.data(), 1, size, file);
-    source[size] = '\0';
-    fclose(file);
+GLuint Graphics::loadShader(const char* filename, GLenum type)
+{
+    return loadShader(filename, type, {});
+}
 
-    return createShader(source.data(), type);
+GLuint Graphics::loadShader(const char* filename, GLenum type, const std::list<const char*>& includes)
+{
+    printf("Loading shader: %s\n", filename);
+    std::string main;
+    if (!readSource(filename, main)) return 0;
+    if (includes.empty()) return createShader(main.c_str(), type);
+
+    size_t version = versionLength(main);
+    std::string source = main.substr(0, version);
+    for (const char* include : includes)
+    {
+        std::string text;
+        if (!readSource(include, text)) return 0;
+        source.append(text, versionLength(text), std::string::npos);
+        source += '\n';
+    }
+    // Keep compile errors pointing at lines of filename
+    source += version ? "#line 2\n" : "#line 1\n";
+    source.append(main, version, std::string::npos);
+    return createShader(source.c_str(), type);
 }
 
 GLuint Graphics::createShader(const GLchar* source, GLenum type)
@@ -0,0 +1,148 @@
+#include "StreamBuffer.hpp"
+#include "Testbed.hpp"
+#include <stdio.h>
+#include <string.h>
+
+using namespace Graphics;
+
+void StreamBuffer::initialize(size_t size)
+{
+    release();
+    capacity = size;
+    head = 0;
+    used = 0;
+    frameBytes = 0;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    if (GLEW_ARB_buffer_storage)
+    {
+        // Coherent, so writes are visible to draws issued after them without flushing
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+        mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+        Testbed::assert(mapped != nullptr, "[StreamBuffer] Failed to map buffer");
+    }
+    else
+    {
+        glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        shadow.resize(size);
+        mapped = &shadow[0];
+    }
+    printf("[StreamBuffer] %zuKB ring, %s\n", size / 1024, isPersistent() ? "persistently mapped" : "uploaded on flush");
+}
+
+bool StreamBuffer::waitOldest()
+{
+    if (fences.empty()) return false;
+    Fence& fence = fences.front();
+    GLenum status = glClientWaitSync(fence.sync, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        // The ring is full, the frames in flight are already submitted
+        status = glClientWaitSync(fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        if (status == GL_TIMEOUT_EXPIRED)
+            printf("[StreamBuffer] Waited over a second on a frame\n");
+    }
+    glDeleteSync(fence.sync);
+    used -= fence.bytes;
+    fences.pop_front();
+    return true;
+}
+
+StreamBuffer::Range StreamBuffer::allocate(size_t size, size_t alignment)
+{
+    Testbed::assert(size <= capacity, "[StreamBuffer] Allocation larger than the ring");
+    size_t offset = (head + alignment - 1) / alignment * alignment;
+    if (offset + size > capacity)
+        offset = 0;
+    size_t needed = (offset >= head ? offset - head : capacity - head + offset) + size;
+
+    while (used + needed > capacity)
+        Testbed::assert(waitOldest(), "[StreamBuffer] One frame allocated more than the ring holds");
+
+    head = offset + size;
+    used += needed;
+    frameBytes += needed;
+
+    Range range = {GLintptr(offset), GLsizeiptr(size), mapped + offset};
+    if (!isPersistent())
+        dirty.push_back(range);
+    return range;
+}
+
+void StreamBuffer::flush()
+{
+    if (dirty.empty()) return;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (const Range& range : dirty)
+        glBufferSubData(GL_ARRAY_BUFFER, range.offset, range.size, range.data);
+    dirty.clear();
+}
+
+void StreamBuffer::endFrame()
+{
+    if (!buffer) return;
+    flush();
+    if (frameBytes == 0) return;
+    fences.push_back({glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), frameBytes});
+    frameBytes = 0;
+}
+
+Surface StreamBuffer::createSurface(const std::vector<Attrib>& attributes, size_t stride)
+{
+    Surface surface = {GL_TRIANGLES, 0, buffer, 0, 0, 0, 0, GL_UNSIGNED_INT};
+    glGenVertexArrays(1, &surface.vao);
+    glBindVertexArray(surface.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+    setVertexAttributes(attributes, stride);
+    layouts.push_back(surface.vao);
+    return surface;
+}
+
+void StreamBuffer::stream(Surface& surface, const Buffer& vertices)
+{
+    // Vertices start on a whole vertex so they can be addressed by base vertex
+    Range range = allocate(vertices.size, vertices.stride);
+    memcpy(range.data, vertices.data, vertices.size);
+    surface.vbo = buffer;
+    surface.ibo = 0;
+    surface.base = GLint(range.offset / vertices.stride);
+    surface.num = GLsizei(vertices.num);
+    flush();
+}
+
+void StreamBuffer::stream(Surface& surface, const Buffer& vertices, const std::vector<GLuint>& indices)
+{
+    stream(surface, vertices);
+    Range range = allocate(sizeof(GLuint) * indices.size(), sizeof(GLuint));
+    memcpy(range.data, indices.data(), range.size);
+    surface.ibo = buffer;
+    surface.indexOffset = range.offset;
+    surface.indexType = GL_UNSIGNED_INT;
+    surface.num = GLsizei(indices.size());
+    flush();
+}
+
+void StreamBuffer::release()
+{
+    if (!buffer) return;
+    for (const Fence& fence : fences)
+        glDeleteSync(fence.sync);
+    fences.clear();
+    if (!layouts.empty())
+        glDeleteVertexArrays(layouts.size(), &layouts[0]);
+    layouts.clear();
+    if (isPersistent())
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+    mapped = nullptr;
+    shadow.clear();
+    dirty.clear();
+    capacity = 0;
+}
@@ -1,14 +1,20 @@
 #include "Testbed.hpp"
 #include "Input.hpp"
+#include "Graphics.hpp"
 #include <GLFW/glfw3.h>
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
 #include <vector>
 
 // Mesa currently only supports 3.3, most extensions are implemented though
 #define GL_MAJOR 3
 #define GL_MINOR 3
-#define GL_VSYNC 0 
 #define GL_DEBUG 1
 // TODO implement cmake configuration for those
 
@@ -22,6 +28,142 @@ using namespace Input;
 
 namespace {
     GLFWwindow* window = nullptr;
+    Options config;
+    int frameCount = 0;
+
+    // Offscreen context used instead of a window when running headless
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    EGLContext eglContext = EGL_NO_CONTEXT;
+    EGLSurface eglSurface = EGL_NO_SURFACE;
+    bool headlessClose = false;
+    chrono::steady_clock::time_point headlessStart;
+
+    // Frame pacing state, fences form a ring of the frames still on the GPU
+    const int MAX_FENCES = 8;
+    const double SPIN_TIME = 0.002;     // Sleeps overshoot, spin for the last couple ms
+    VSync vsync = VSYNC_OFF;
+    double frameLimit = 0.0;
+    double nextFrame = -1.0;
+    int maxFramesInFlight = 0;
+    GLsync fences[MAX_FENCES] = {};
+    int fenceHead = 0;
+    int fenceCount = 0;
+
+    void limitFrameRate()
+    {
+        if (frameLimit <= 0.0) return;
+        double period = 1.0 / frameLimit;
+        double now = getTime();
+
+        // After a long stall restart the schedule rather than rushing to catch up
+        if (nextFrame < 0.0 || now - nextFrame > period)
+            nextFrame = now;
+
+        double sleep = nextFrame - now - SPIN_TIME;
+        if (sleep > 0.0)
+            this_thread::sleep_for(chrono::duration<double>(sleep));
+        while (getTime() < nextFrame)
+            this_thread::yield();
+        nextFrame += period;
+    }
+
+    void waitOldestFence()
+    {
+        GLsync& fence = fences[fenceHead];
+        GLenum result;
+        do result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+        while (result == GL_TIMEOUT_EXPIRED);
+        glDeleteSync(fence);
+        fence = 0;
+        fenceHead = (fenceHead + 1) % MAX_FENCES;
+        fenceCount--;
+    }
+
+    void throttleFrames()
+    {
+        if (maxFramesInFlight <= 0) return;
+        fences[(fenceHead + fenceCount) % MAX_FENCES] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        fenceCount++;
+        while (fenceCount > maxFramesInFlight)
+            waitOldestFence();
+    }
+
+    void clearFences()
+    {
+        while (fenceCount > 0)
+        {
+            glDeleteSync(fences[fenceHead]);
+            fences[fenceHead] = 0;
+            fenceHead = (fenceHead + 1) % MAX_FENCES;
+            fenceCount--;
+        }
+        fenceHead = 0;
+    }
+
+    void initializePacing()
+    {
+        setVSync(config.vsync);
+        setFrameLimit(config.fpsLimit);
+        setMaxFramesInFlight(config.framesInFlight);
+    }
+
+    // Prefer Mesa's surfaceless platform so no X or Wayland server is needed
+    EGLDisplay getHeadlessDisplay()
+    {
+        const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless"))
+        {
+            auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if (getPlatformDisplay)
+            {
+                EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+                if (display != EGL_NO_DISPLAY) return display;
+            }
+        }
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    void initializeHeadless()
+    {
+        eglDisplay = getHeadlessDisplay();
+        assert(eglDisplay != EGL_NO_DISPLAY, "[Testbed] Failed to get EGL display");
+        assert(eglInitialize(eglDisplay, nullptr, nullptr), "[Testbed] Failed to initialize EGL");
+        assert(eglBindAPI(EGL_OPENGL_API), "[Testbed] EGL does not support desktop OpenGL");
+
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+            EGL_DEPTH_SIZE, 24,
+            EGL_NONE
+        };
+        EGLConfig eglConfig;
+        EGLint numConfigs = 0;
+        eglChooseConfig(eglDisplay, configAttribs, &eglConfig, 1, &numConfigs);
+        assert(numConfigs > 0, "[Testbed] No EGL pbuffer config available");
+
+        const EGLint surfaceAttribs[] = {
+            EGL_WIDTH, config.width,
+            EGL_HEIGHT, config.height,
+            EGL_NONE
+        };
+        eglSurface = eglCreatePbufferSurface(eglDisplay, eglConfig, surfaceAttribs);
+        assert(eglSurface != EGL_NO_SURFACE, "[Testbed] Failed to create pbuffer surface");
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, GL_MAJOR,
+            EGL_CONTEXT_MINOR_VERSION, GL_MINOR,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_CONTEXT_OPENGL_DEBUG, GL_DEBUG,
+            EGL_NONE
+        };
+        eglContext = eglCreateContext(eglDisplay, eglConfig, EGL_NO_CONTEXT, contextAttribs);
+        assert(eglContext != EGL_NO_CONTEXT, "[Testbed] Failed to create EGL context");
+        assert(eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext), "[Testbed] Failed to make EGL context current");
+
+        headlessStart = chrono::steady_clock::now();
+        printf("[Testbed] Created headless %dx%d EGL context\n", config.width, config.height);
+    }
 
     void glfwError(int error, const char* msg)
     {
@@ -29,12 +171,32 @@ namespace {
         // Possibly quit from here
     }
 
+    // Events are written into a fixed ring by the GLFW callbacks. Indices only
+    // grow, poll() dispatches from dispatched and drainEvents() reads from read.
+    const size_t EVENT_CAPACITY = 4096;   // Power of two
+    Event events[EVENT_CAPACITY];
+    size_t eventsWritten = 0;
+    size_t eventsDispatched = 0;
+    size_t eventsRead = 0;
+    size_t eventsDropped = 0;
+
+    Event& pushEvent(Event::Type type)
+    {
+        Event& event = events[eventsWritten++ & (EVENT_CAPACITY - 1)];
+        event.type = type;
+        event.time = getTime();
+        return event;
+    }
+
     double mouseX, mouseY;
     vector<function<void(double,double)>> mouseMoveCallbacks;
     void glfwMouseMove(GLFWwindow*, double x, double y)
     {
-        for (auto callback : mouseMoveCallbacks)
-            callback(x - mouseX, y - mouseY);
+        Event& event = pushEvent(Event::MOUSE_MOVE);
+        event.mouse.x = x;
+        event.mouse.y = y;
+        event.mouse.dx = x - mouseX;
+        event.mouse.dy = y - mouseY;
         mouseX = x;
         mouseY = y;
     }
@@ -44,19 +206,52 @@ namespace {
     void glfwKey(GLFWwindow*, int key, int, int action, int)
     {
         if (action == GLFW_PRESS)
-            for (auto callback : keyPressCallbacks)
-                callback(Key(key));
+            pushEvent(Event::KEY_PRESS).key = Key(key);
+        else if (action == GLFW_RELEASE)
+            pushEvent(Event::KEY_RELEASE).key = Key(key);
+    }
+
+    void glfwMouseButton(GLFWwindow*, int button, int action, int)
+    {
+        if (action == GLFW_PRESS)
+            pushEvent(Event::BUTTON_PRESS).button = Button(button);
         else if (action == GLFW_RELEASE)
-            for (auto callback : keyReleaseCallbacks)
-                callback(Key(key));
+            pushEvent(Event::BUTTON_RELEASE).button = Button(button);
     }
 
     vector<function<void(int,int)>> resizeCallbacks;
     void glfwResize(GLFWwindow*, int width, int height)
     {
         glfwGetCursorPos(window, &mouseX, &mouseY);
-        for (auto callback : resizeCallbacks)
-            callback(width, height);
+        Event& event = pushEvent(Event::RESIZE);
+        event.size.width = width;
+        event.size.height = height;
+    }
+
+    // Callbacks are taken by reference, copying a std::function may allocate
+    void dispatch(const Event& event)
+    {
+        switch (event.type)
+        {
+        case Event::MOUSE_MOVE:
+            for (const auto& callback : mouseMoveCallbacks)
+                callback(event.mouse.dx, event.mouse.dy);
+            break;
+        case Event::KEY_PRESS:
+            for (const auto& callback : keyPressCallbacks)
+                callback(event.key);
+            break;
+        case Event::KEY_RELEASE:
+            for (const auto& callback : keyReleaseCallbacks)
+                callback(event.key);
+            break;
+        case Event::RESIZE:
+            for (const auto& callback : resizeCallbacks)
+                callback(event.size.width, event.size.height);
+            break;
+        default:
+            break;
+        }
     }
 }
 
@@ -74,11 +269,72 @@ void Testbed::assert(bool condition, const char* msg)
     }
 }
 
-void Testbed::initialize()
+Options Testbed::parseOptions(int argc, char* argv[])
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--headless"))
+            options.headless = true;
+        else if (!strcmp(argv[i], "--size") && i + 1 < argc)
+            sscanf(argv[++i], "%dx%d", &options.width, &options.height);
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+            options.frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--report") && i + 1 < argc)
+            options.report = argv[++i];
+        else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+            options.record = argv[++i];
+        else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+            options.replay = argv[++i];
+        else if (!strcmp(argv[i], "--dt") && i + 1 < argc)
+            options.dt = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--benchmark") && i + 1 < argc)
+            options.benchmark = argv[++i];
+        else if (!strcmp(argv[i], "--threaded"))
+            options.threaded = true;
+        else if (!strcmp(argv[i], "--vsync") && i + 1 < argc)
+        {
+            const char* mode = argv[++i];
+            if (!strcmp(mode, "on")) options.vsync = VSYNC_ON;
+            else if (!strcmp(mode, "adaptive")) options.vsync = VSYNC_ADAPTIVE;
+            else options.vsync = VSYNC_OFF;
+        }
+        else if (!strcmp(argv[i], "--fps") && i + 1 < argc)
+            options.fpsLimit = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--frames-in-flight") && i + 1 < argc)
+            options.framesInFlight = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--capture") && i + 1 < argc)
+            options.capture = argv[++i];
+        else if (!strcmp(argv[i], "--golden") && i + 1 < argc)
+            options.golden = argv[++i];
+        else if (!strcmp(argv[i], "--update-golden"))
+            options.updateGolden = true;
+        else if (!strcmp(argv[i], "--ssr") && i + 1 < argc)
+            options.ssr = argv[++i];
+        else if (!strcmp(argv[i], "--strips"))
+            options.strips = true;
+        else if (!strcmp(argv[i], "--no-indirect"))
+            options.indirect = false;
+        else if (!strcmp(argv[i], "--no-arena"))
+            options.arena = false;
+    }
+    return options;
+}
+
+void Testbed::initialize(const Options& options)
 {
     printf("[Testbed] Initializing\n");
     // Dont reinitialize unnecessarily
-    if (window) return;
+    if (window || eglContext != EGL_NO_CONTEXT) return;
+    config = options;
+    frameCount = 0;
+
+    if (config.headless)
+    {
+        initializeHeadless();
+        initializePacing();
+        return;
+    }
     // TODO add mechanism to specifiy window attributes
     // this doesnt really matter since I have a tiling wm
 
@@ -98,50 +354,135 @@ void Testbed::initialize()
     
     // Create a fullscreen window
 //    window = glfwCreateWindow(res.width, res.height, "Testbed", monitor, nullptr);
-    window = glfwCreateWindow(1600, 900, "Testbed", nullptr, nullptr);
+    window = glfwCreateWindow(config.width, config.height, "Testbed", nullptr, nullptr);
     assert(window, "[Testbed] Failed to create window");
 
     // Initialize OpenGL context
     glfwMakeContextCurrent(window);
-    glfwSwapInterval(GL_VSYNC);
+    initializePacing();
 
     glfwSetWindowSizeCallback(window, &glfwResize);
     glfwSetCursorPosCallback(window, &glfwMouseMove);
     glfwSetKeyCallback(window, &glfwKey);
+    glfwSetMouseButtonCallback(window, &glfwMouseButton);
 
     glfwGetCursorPos(window, &mouseX, &mouseY);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 }
 
+const Options& Testbed::getOptions()
+{
+    return config;
+}
+
 void Testbed::shutdown()
 {
     printf("[Testbed] Shutting down\n");
+    clearFences();
+    if (eglDisplay != EGL_NO_DISPLAY)
+    {
+        eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (eglContext != EGL_NO_CONTEXT) eglDestroyContext(eglDisplay, eglContext);
+        if (eglSurface != EGL_NO_SURFACE) eglDestroySurface(eglDisplay, eglSurface);
+        eglTerminate(eglDisplay);
+        eglDisplay = EGL_NO_DISPLAY;
+        eglContext = EGL_NO_CONTEXT;
+        eglSurface = EGL_NO_SURFACE;
+        return;
+    }
     // Windows are destroyed in glfwTerminate()
     glfwTerminate();
+    window = nullptr;
 }
 
 bool Testbed::running()
 {
+    if (!window) return !headlessClose;
     return !glfwWindowShouldClose(window);
 }
 
 void Testbed::stop()
 {
-    glfwSetWindowShouldClose(window, GL_TRUE);
+    if (!window) headlessClose = true;
+    else glfwSetWindowShouldClose(window, GL_TRUE);
 }
 
 void Testbed::update()
 {
-    glfwSwapBuffers(window);
+    limitFrameRate();
+    if (window) glfwSwapBuffers(window);
+    else eglSwapBuffers(eglDisplay, eglSurface);
+    throttleFrames();
+
+    if (config.frames > 0 && ++frameCount >= config.frames)
+        stop();
+}
+
+void Testbed::setVSync(VSync mode)
+{
+    vsync = mode;
+    if (mode == VSYNC_ADAPTIVE && window && !glfwExtensionSupported("GLX_EXT_swap_control_tear")
+                                         && !glfwExtensionSupported("WGL_EXT_swap_control_tear"))
+    {
+        printf("[Testbed] Adaptive vsync not supported, using vsync\n");
+        vsync = VSYNC_ON;
+    }
+    // EGL has no tearing swap, and pbuffers ignore the interval anyway
+    if (vsync == VSYNC_ADAPTIVE && !window)
+        vsync = VSYNC_ON;
+
+    if (window) glfwSwapInterval(vsync);
+    else if (eglDisplay != EGL_NO_DISPLAY) eglSwapInterval(eglDisplay, vsync);
+    printf("[Testbed] VSync %s\n", vsync == VSYNC_OFF ? "off" : vsync == VSYNC_ON ? "on" : "adaptive");
+}
+
+VSync Testbed::getVSync()
+{
+    return vsync;
+}
+
+void Testbed::setFrameLimit(double fps)
+{
+    frameLimit = fps > 0.0 ? fps : 0.0;
+    nextFrame = -1.0;
+}
+
+double Testbed::getFrameLimit()
+{
+    return frameLimit;
+}
+
+void Testbed::setMaxFramesInFlight(int frames)
+{
+    if (frames < 0) frames = 0;
+    if (frames > MAX_FENCES - 1) frames = MAX_FENCES - 1;
+    maxFramesInFlight = frames;
+    if (frames == 0)
+        clearFences();
+    while (fenceCount > maxFramesInFlight)
+        waitOldestFence();
+}
+
+int Testbed::getMaxFramesInFlight()
+{
+    return maxFramesInFlight;
+}
+
+bool Testbed::isHeadless()
+{
+    return eglContext != EGL_NO_CONTEXT;
 }
 
 double Testbed::getTime()
 {
+    if (!window)
+        return chrono::duration<double>(chrono::steady_clock::now() - headlessStart).count();
     return glfwGetTime();
 }
 
 int Testbed::getScreenWidth()
 {
+    if (!window) return config.width;
     int width, height;
     glfwGetFramebufferSize(window, &width, &height);
     return width;
@@ -149,6 +490,7 @@ int Testbed::getScreenWidth()
 
 int Testbed::getScreenHeight()
 {
+    if (!window) return config.height;
     int width, height;
     glfwGetFramebufferSize(window, &width, &height);
     return height;
@@ -165,17 +507,42 @@ void Testbed::addResizeCallback(function<void(int,int)> callback)
 
 void Input::poll()
 {
+    if (!window) return;
     glfwPollEvents();
+
+    // A single poll can only outrun the ring if thousands of events arrived
+    if (eventsWritten - eventsDispatched > EVENT_CAPACITY)
+        eventsDispatched = eventsWritten - EVENT_CAPACITY;
+    for (; eventsDispatched < eventsWritten; eventsDispatched++)
+        dispatch(events[eventsDispatched & (EVENT_CAPACITY - 1)]);
+}
+
+size_t Input::drainEvents(Event* out, size_t max)
+{
+    if (eventsWritten - eventsRead > EVENT_CAPACITY)
+    {
+        eventsDropped += eventsWritten - eventsRead - EVENT_CAPACITY;
+        eventsRead = eventsWritten - EVENT_CAPACITY;
+    }
+    size_t count = 0;
+    for (; count < max && eventsRead < eventsWritten; count++)
+        out[count] = events[eventsRead++ & (EVENT_CAPACITY - 1)];
+    return count;
+}
+
+size_t Input::getDroppedEvents()
+{
+    return eventsDropped;
 }
 
 bool Input::isKeyPressed(Input::Key key)
 {
-    return glfwGetKey(window, key);
+    return window && glfwGetKey(window, key);
 }
 
 bool Input::isMousePressed(Input::Button button)
 {
-    return glfwGetMouseButton(window, button);
+    return window && glfwGetMouseButton(window, button);
 }
 
 double Input::getMouseX()
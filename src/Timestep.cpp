@@ -0,0 +1,30 @@
+#include "Timestep.hpp"
+
+using namespace Testbed;
+
+FixedTimestep::FixedTimestep(double tick, int maxSteps) :
+    tick(tick), maxSteps(maxSteps), accumulator(0.0), time(0.0), dropped(0.0)
+{
+}
+
+int FixedTimestep::advance(double dt)
+{
+    accumulator += dt;
+
+    int steps = 0;
+    while (accumulator >= tick && steps < maxSteps)
+    {
+        accumulator -= tick;
+        time += tick;
+        steps++;
+    }
+
+    // Throw away whole ticks we could not catch up on, keep the fraction
+    if (accumulator >= tick)
+    {
+        double excess = tick * int(accumulator / tick);
+        dropped += excess;
+        accumulator -= excess;
+    }
+    return steps;
+}
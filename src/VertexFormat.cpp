@@ -0,0 +1,90 @@
+#include "VertexFormat.hpp"
+#include <string.h>
+
+uint16_t Graphics::packHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int exponent = int((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (exponent >= 31)
+    {
+        // Overflow to infinity, NaN stays NaN
+        bool nan = ((bits >> 23) & 0xff) == 0xff && mantissa;
+        return uint16_t(sign | 0x7c00 | (nan ? 0x200 : 0));
+    }
+    if (exponent <= 0)
+    {
+        // Denormal or zero, the implicit one becomes explicit
+        if (exponent < -10) return uint16_t(sign);
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) half++;
+        return uint16_t(sign | half);
+    }
+
+    // Round to nearest even, a carry into the exponent is still correct
+    uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+    return uint16_t(half);
+}
+
+float Graphics::unpackHalf(uint16_t value)
+{
+    uint32_t sign = uint32_t(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t bits;
+
+    if (exponent == 31)
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    else if (exponent)
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    else if (mantissa)
+    {
+        // Denormal, normalize it
+        exponent = 127 - 15 + 1;
+        while (!(mantissa & 0x400))
+        {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    else
+        bits = sign;
+
+    float result;
+    memcpy(&result, &bits, 4);
+    return result;
+}
+
+void Graphics::pack(Half2& out, const glm::vec2& in)
+{
+    out.x = packHalf(in.x);
+    out.y = packHalf(in.y);
+}
+
+void Graphics::pack(Half4& out, const glm::vec4& in)
+{
+    out.x = packHalf(in.x);
+    out.y = packHalf(in.y);
+    out.z = packHalf(in.z);
+    out.w = packHalf(in.w);
+}
+
+void Graphics::pack(Int1010102N& out, const glm::vec3& in, int w)
+{
+    // Two's complement fields, x in the lowest bits as GL_INT_2_10_10_10_REV expects
+    auto field = [](float value) {
+        value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+        return uint32_t(int32_t(value * 511.0f + (value < 0.0f ? -0.5f : 0.5f))) & 0x3ff;
+    };
+    out.bits = field(in.x) | (field(in.y) << 10) | (field(in.z) << 20) | (uint32_t(w & 3) << 30);
+}
@@ -1,4 +1,5 @@
 #include "Testbed.hpp"
+#include "FrameStats.hpp"
 #include "Graphics.hpp"
 #include "Input.hpp"
 #include "Shader.hpp"
@@ -31,6 +32,7 @@ const Vertex verts[] = {
 
 #define SENSITIVITY 0.01f
 Camera camera(0,0,0,0);
+Testbed::FrameStats frameStats;
 
 GLuint vao = 0;
 GLuint vbo = 0;
@@ -110,18 +112,13 @@ void update(double dt)
 {
     const double period = 2.0;
     static double time = 0.0;
-    static int frames = 0;
 
+    frameStats.add(dt);
+    time += dt;
     if (time >= period)
     {
-        printf("Average Frame Time: %f (%.2ffps)\n", time / frames, frames / time);
+        frameStats.print();
         time = 0;
-        frames = 0;
-    }
-    else 
-    {
-        time += dt;
-        frames++;
     }
 
     Input::poll();
@@ -156,6 +153,7 @@ void shutdown()
     glDeleteVertexArrays(1, &vao);
     glDeleteProgram(shader);
 
+    if (Testbed::getOptions().report) frameStats.write(Testbed::getOptions().report, "GraphicsTest");
     Graphics::shutdown();
     Testbed::shutdown();
 }
@@ -1,23 +1,52 @@
 #include "Testbed.hpp"
+#include "FrameStats.hpp"
+#include "Benchmark.hpp"
+#include "GoldenTest.hpp"
+#include "Timestep.hpp"
+#include "FramePipeline.hpp"
+#include "Jobs.hpp"
 #include "Graphics.hpp"
 #include "Input.hpp"
 #include "Shader.hpp"
 #include "Camera.hpp"
 #include "Mesh.hpp"
+#include "VertexFormat.hpp"
+#include "MeshOptimizer.hpp"
 #include "Texture.hpp"
 #include "LEAN.hpp"
 #include "RenderTarget.hpp"
+#include "HiZ.hpp"
+#include "RenderGraph.hpp"
+#include "Profiler.hpp"
+#include "FrameCapture.hpp"
+#include "StreamBuffer.hpp"
+#include "GeometryArena.hpp"
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <glm/glm.hpp>
+#include <memory>
+#include <algorithm>
+#include <random>
 #undef assert
 
-void initialize();
+struct FramePacket;
+
+void initialize(const Testbed::Options& options);
 void reloadShaders();
 void resize(int x, int y);
+void updateTargets();
+void allocateHistory();
+void updateTraceOptions();
+void buildGraph(const FramePacket& packet);
+void captureFrame();
 void update(double dt);
-void render();
+void syncFrame();
+void produceFrame(FramePacket& packet);
+void simulate(double dt);
+void render(const FramePacket& packet);
 void shutdown();
+void buildScenery();
 
 // Vertices for test buffer
 
@@ -28,44 +57,166 @@ struct Vertex
 };
 
 Mesh<Vertex> modelData = {
-    {{3, GL_FLOAT}, {3, GL_FLOAT}},
+    Graphics::vertexFormat(&Vertex::position, &Vertex::color),
     {{glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(1.0f, 1.0f, 0.0f)},
      {glm::vec3( 1.0f, -1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f)},
      {glm::vec3( 0.0f,  1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)}}
 };
 
-IndexedMesh<glm::vec2> terrainData = {{{2, GL_FLOAT}}, {}, {}};
+// Drawn with 8 bit colors
+struct PackedVertex
+{
+    glm::vec3 position;
+    Graphics::UByte4N color;
+};
+
+Mesh<PackedVertex> packedModel;
+
+// Grid coordinates are whole numbers, which half floats hold exactly
+IndexedMesh<Graphics::Half2> terrainData = {Graphics::vertexFormat<Graphics::Half2>(), {}, {}};
 
 
+// Rocks and shrubs scattered over the terrain, every shape lives in one
+// geometry arena and the visible instances of all of them are one bucket
+struct SceneryVertex
+{
+    glm::vec3 position;
+    Graphics::Int1010102N normal;
+};
+
+struct SceneryInstance
+{
+    glm::vec4 transformX;   // Rows of the object to world transform, see scenery.vert
+    glm::vec4 transformY;
+    glm::vec4 transformZ;
+    Graphics::UByte4N color;
+    float lod;
+};
+
+enum SceneryShape { SHRUB, ROCK, NUM_SHAPES };
+Graphics::GeometryArena::Range sceneryShapes[NUM_SHAPES];
+std::vector<SceneryInstance> sceneryPlacement;  // Every instance grouped by shape, the frame's visible ones go in the packet
+size_t sceneryFirst[NUM_SHAPES + 1];            // First instance of each shape in sceneryPlacement
+
+#define SCENERY_COUNT 4096
+#define SCENERY_FADE 16.0f  // Instances start shrinking this far from the camera
+#define SCENERY_RANGE 24.0f // and are gone here
+
 IndexedMesh<glm::vec2> oceanData = {
-    {{2, GL_FLOAT}},
+    Graphics::vertexFormat<glm::vec2>(),
     {glm::vec2(-20.0f, -20.0f), glm::vec2(-20.0f, 20.0f), glm::vec2(20.0f, -20.0f), glm::vec2(20.0f, 20.0f)},
     {0, 1, 2, 2, 1, 3}
 };
 
 #define SENSITIVITY 0.01f
 Camera camera(0,0,0,0);
+Testbed::FrameStats frameStats;
+Testbed::FrameStats inputLatency;   // Oldest input event of a frame to its swap
+Testbed::Benchmark benchmark;
+Testbed::GoldenTest golden;         // --golden compares fixed poses against reference images
+Testbed::FrameCapture frameCapture; // --capture writes every frame, P a single screenshot
+bool screenshot = false;
 
-// Framebuffer and color/depth targets TODO wrap in RenderTarget class or something
+// Passes and their targets are declared every frame in buildGraph. The opaque
+// pass renders into a transient scene target which the ocean samples while
+// drawing to the screen.
+RenderGraph graph;
 RenderTarget screen;
-RenderTarget secondary;
+RenderTargetPool targetPool;    // Targets kept across frames
+HiZ hiz;
+bool hierarchical = true;
+bool printGraph = true;
+
+// Targets follow the window size once it stops changing for this long
+#define RESIZE_DELAY 0.15
+int targetWidth = 0;
+int targetHeight = 0;
+int resizeWidth = 0;
+int resizeHeight = 0;
+double resizeTime = -1.0;
 
-// Renderable surfaces  TODO other forms of surfaces (Instanced, Indexing, etc)
-Graphics::Surface model{0};
+// Reflections and refractions can be traced at a fraction of the resolution
+// into an ssr target, then upsampled by the full resolution ocean pass
+int ssrScale = 1;   // Resolution divisor, 1, 2 or 4
+
+// Temporal mode traces cheaply and resolves each frame into one of two
+// history targets, blending with the reprojected other one
+bool temporal = false;
+RenderTarget history[2];
+int historyIndex = 0;
+bool historyValid = false;
+Graphics::Shader resolveShader;
+GLuint emptyVAO = 0;
+
+// Where reflections are traced. Forward draws the ocean a second time to
+// trace. The others write normal, roughness and linear depth of every opaque
+// surface and the water into a G-buffer, then trace all reflections in one
+// pass, either full screen in a fragment shader or in 8x8 compute tiles that
+// skip what doesn't reflect. Reduced resolution and temporal tracing only
+// apply to the forward path.
+enum Backend { FORWARD, DEFERRED, COMPUTE, NUM_BACKENDS };
+const char* backendNames[] = {"forward", "deferred", "compute"};
+Backend backend = FORWARD;
+bool computeSupported = false;      // Compute shaders need GL 4.3
+Graphics::Shader deferredShader;    // Traces the G-buffer
+Graphics::Shader tiledShader;       // Traces the G-buffer in tiles
+Graphics::Shader compositeShader;   // Adds the reflections to opaque surfaces
+
+// Mip levels of the scene color the rough reflection blur can reach, the rest are never allocated
+#define SSR_LEVELS 6
+
+// Texture units the shaders sample from
+enum Unit
+{
+    HEIGHTMAP_UNIT = 1,
+    GRADIENT_UNIT,
+    COVARIANCE_UNIT,
+    BACKBUFFER_UNIT,
+    DEPTH_UNIT,
+    HIZ_UNIT,
+    SSR_REFLECTION_UNIT,
+    SSR_REFRACTION_UNIT,
+    SSR_SURFACE_UNIT,
+    SSR_MOTION_UNIT,
+    HISTORY_REFLECTION_UNIT,
+    HISTORY_REFRACTION_UNIT,
+    GBUFFER_UNIT
+};
+
+// What ocean.frag does with its reflections, mirrors the SSR_* constants there
+enum SSRMode
+{
+    SSR_FULL = 0,       // Traces in place at full resolution
+    SSR_TRACE,          // Traces into a reduced resolution target
+    SSR_UPSAMPLE,       // Upsamples that target
+    SSR_GBUFFER,        // Writes the water into the G-buffer
+    SSR_DEFERRED,       // Reflections from the shared resolve
+    SSR_TILED           // Reflections and refractions from the tiled compute pass
+};
+
+// Renderable surfaces
+Graphics::Surface model{0};    // Streamed every frame, as CPU generated geometry would be
 Graphics::Surface terrain{0};
 Graphics::Surface ocean{0};
+Graphics::GeometryArena sceneryArena;
+Graphics::InstancedSurface sceneryShapeSurfaces[NUM_SHAPES];   // With --no-arena, one per shape instead of the arena
+Graphics::StreamBuffer stream;  // Ring for geometry that changes every frame
 
 // Shaders for different materials TODO pack into material object, use pipeline objects
 using Graphics::Shader;
 Shader modelShader;
 Shader terrainShader;
 Shader oceanShader;
+Shader sceneryShader;
 
 struct WorldData {
   glm::mat4 mvp;
   glm::vec3 eye;
   float time;
   glm::vec2 dim;
+  float frame;
+  float pad;            // std140 aligns the matrix to 16 bytes
+  glm::mat4 prevMvp;
 };
 
 // Uniforms TODO pack shared data into UBO
@@ -76,15 +227,58 @@ GLuint heightmap = 0;
 GLuint gradient = 0;
 GLuint covariance = 0;
 
+// Simulation runs at a fixed rate, state from the tick before is kept for interpolation
+#define TICK_RATE 120.0
+Testbed::FixedTimestep timestep(1.0 / TICK_RATE);
+glm::vec3 previousPosition;
+float previousTime = 0.0f;
+
+// Input gathered on the main thread, handed to the simulation in syncFrame
+struct FrameInput
+{
+    double dt;
+    glm::vec2 look;         // Accumulated mouse movement
+    glm::vec2 move;         // Forward and right key directions
+    float up;
+    glm::vec2 dimensions;
+    bool resized;
+    double eventTime;       // Arrival of the oldest event in this frame, 0 if none
+};
+FrameInput pending = {0.0};
+FrameInput input = {0.0};
+
+// Everything the GL thread needs to draw one frame
+struct Draw
+{
+    const Graphics::Surface* surface;
+    const Shader* shader;
+    bool cull;
+    Graphics::GeometryArena* arena;     // Instead of surface, a bucket of commands drawn from arena
+    const std::vector<Graphics::GeometryArena::Command>* commands;
+    const Graphics::InstancedSurface* instanced;    // Instead of surface, drawn with its uploaded instances
+};
+
+struct FramePacket
+{
+    WorldData world;
+    double eventTime;
+    std::vector<Draw> opaque;   // Scene drawn before the copy
+    std::vector<Draw> water;    // Drawn after, sampling the copied scene
+    std::vector<SceneryInstance> scenery;   // In range of the camera, uploaded before drawing
+    std::vector<Graphics::GeometryArena::Command> sceneryCommands;  // One per shape, over scenery
+};
+
+// Simulation and packet building for frame N+1 can overlap drawing frame N
+Testbed::FramePipeline<FramePacket> pipeline;
+
 // Global transformation matrix
 float totalTime = 0.0f;
-glm::vec2 dimensions;
 bool rough = true;
 
 int main(int argc, char* argv[])
 {
     printf("%s\n", argv[0]);
-    initialize();
+    ::initialize(Testbed::parseOptions(argc, argv));
 
     double prevTime, currTime = Testbed::getTime(); // TODO wrap in timer or fpscounter class
     while (Testbed::running())
@@ -92,74 +286,125 @@ int main(int argc, char* argv[])
         prevTime = currTime;
         currTime = Testbed::getTime(); 
         update(currTime - prevTime);
-        render();
+        render(pipeline.swap());
     }
 
     shutdown();
+    return golden.passed() ? 0 : 1;
 }
 
-void initialize()
+void initialize(const Testbed::Options& options)
     
 {
     // Initialize used libraries
-    Testbed::initialize();
+    Testbed::initialize(options);
     Graphics::initialize(true);
+    for (int i = 0; options.ssr && i < NUM_BACKENDS; i++)
+        if (!strcmp(options.ssr, backendNames[i])) backend = Backend(i);
+    computeSupported = GLEW_VERSION_4_3;
+    if (backend == COMPUTE && !computeSupported)
+    {
+        printf("Compute shaders need GL 4.3, tracing with the deferred backend\n");
+        backend = DEFERRED;
+    }
+    Testbed::Jobs::initialize();
+    benchmark.initialize(options);
+    golden.initialize(options);
+    Graphics::Profiler::initialize();
     Testbed::addResizeCallback(&resize);
     Input::addKeyPressCallback([](Input::Key key) { if (key == Input::KEY_ESCAPE) Testbed::stop(); });
     Input::addKeyPressCallback([](Input::Key key) { if (key == Input::KEY_R) reloadShaders(); });
+    Input::addKeyPressCallback([](Input::Key key) { if (key == Input::KEY_P) screenshot = true; });
     Input::addKeyPressCallback([](Input::Key key) { if (key == Input::KEY_1) glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); }); 
     Input::addKeyPressCallback([](Input::Key key) { if (key == Input::KEY_2) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); });
-    Input::addKeyPressCallback([](Input::Key key) { if (key == Input::KEY_E) rough = !rough; oceanShader["rough"].set(rough); });
-    Input::addMouseMoveCallback([](double dx, double dy) { camera.look(dx * SENSITIVITY, dy * SENSITIVITY); });
+    Input::addKeyPressCallback([](Input::Key key) { if (key == Input::KEY_E) { rough = !rough; updateTraceOptions(); } });
+    Input::addKeyPressCallback([](Input::Key key) {
+        if (key != Input::KEY_H) return;
+        hierarchical = !hierarchical;
+        updateTraceOptions();
+        printGraph = true;
+    });
+    Input::addKeyPressCallback([](Input::Key key) {
+        // Cycles forward, deferred and compute tracing
+        if (key != Input::KEY_G) return;
+        backend = Backend((backend + 1) % (computeSupported ? NUM_BACKENDS : COMPUTE));
+        printf("Tracing SSR with the %s backend\n", backendNames[backend]);
+        allocateHistory();
+    });
+    Input::addKeyPressCallback([](Input::Key key) {
+        if (key != Input::KEY_Y) return;
+        temporal = !temporal;
+        printf("Temporal SSR %s\n", temporal ? "on" : "off");
+        allocateHistory();
+    });
+    Input::addKeyPressCallback([](Input::Key key) {
+        // Cycles full, half and quarter resolution tracing
+        if (key != Input::KEY_T) return;
+        ssrScale = ssrScale == 4 ? 1 : ssrScale * 2;
+        printf("Tracing SSR at 1/%d resolution\n", ssrScale);
+        allocateHistory();
+    });
+    Input::addKeyPressCallback([](Input::Key key) {
+        // Cycles off, adaptive, on
+        using namespace Testbed;
+        if (key == Input::KEY_V) setVSync(getVSync() == VSYNC_OFF ? VSYNC_ADAPTIVE : getVSync() == VSYNC_ADAPTIVE ? VSYNC_ON : VSYNC_OFF);
+    });
 
     glEnable(GL_DEPTH_TEST);
     glClearColor(0.0, 191.0f/255.0f, 1.0, 1.0);
 
-    // Fill terrain vertex buffer
-    terrainData.vertices.reserve(41 * 41);
-    for (float y = -20.0f; y <= 20.0f; y += 1.0f)
-        for (float x = -20.0f; x <= 20.0f; x += 1.0f)
-            terrainData.vertices.push_back(glm::vec2(x, y));
+    // Read the LEAN map on a worker while the terrain is built and uploaded
+    std::unique_ptr<LEANMap> lean;
+    Testbed::Jobs::Job leanLoad = Testbed::Jobs::run([&] { lean.reset(new LEANMap("res/water.lean")); });
 
-    terrainData.indices.reserve(40 * 40 * 2 * 3);
-    for (unsigned i = 0; i < 40; i++)
-    {
-        for (unsigned j = 0; j < 40; j++)
-        {
-            const unsigned width = 41;
-            unsigned index = i*width + j;
-            terrainData.indices.push_back(index);
-            terrainData.indices.push_back(index + width);
-            terrainData.indices.push_back(index + 1);
-
-            terrainData.indices.push_back(index + 1);
-            terrainData.indices.push_back(index + width);
-            terrainData.indices.push_back(index + width + 1);
-        }
-    }
+    // Fill terrain vertex buffer, each row writes its own slice
+    const unsigned width = 41;
+    terrainData.vertices.resize(width * width);
+    Testbed::Jobs::parallelFor(0, width, 8, [&](size_t first, size_t last) {
+        for (unsigned i = first; i < last; i++)
+            for (unsigned j = 0; j < width; j++)
+                Graphics::pack(terrainData.vertices[i*width + j], glm::vec2(j - 20.0f, i - 20.0f));
+    });
+    terrainData.indices = Graphics::gridIndices(width, width);
+    Graphics::optimizeMesh(terrainData, "terrain", options.strips);
+    Graphics::optimizeMesh(oceanData, "ocean");
 
     terrain = Graphics::createSurface(terrainData);
-    model = Graphics::createSurface(modelData);
+    stream.initialize(4 << 20);
+    packedModel = Graphics::quantize<PackedVertex>(modelData,
+        Graphics::vertexFormat(&PackedVertex::position, &PackedVertex::color), [](const Vertex& v) {
+            PackedVertex packed;
+            Graphics::pack(packed.position, v.position);
+            Graphics::pack(packed.color, v.color);
+            return packed;
+        });
+    model = stream.createSurface(packedModel.attributes, sizeof(PackedVertex));
     ocean = Graphics::createSurface(oceanData);
+    buildScenery();
 
-    glActiveTexture(GL_TEXTURE1);
+    glActiveTexture(GL_TEXTURE0 + HEIGHTMAP_UNIT);
     heightmap = Graphics::createTexture("res/heightmap.png");
     glBindTexture(GL_TEXTURE_2D, heightmap);
 
-    LEANMap lean("res/water.lean");
-    glActiveTexture(GL_TEXTURE2);
-    gradient = Graphics::loadLEANGradient(lean);
+    Testbed::Jobs::wait(leanLoad);
+    glActiveTexture(GL_TEXTURE0 + GRADIENT_UNIT);
+    gradient = Graphics::loadLEANGradient(*lean);
     glBindTexture(GL_TEXTURE_2D, gradient);
-    glActiveTexture(GL_TEXTURE3);
-    covariance = Graphics::loadLEANCovariance(lean);
+    glActiveTexture(GL_TEXTURE0 + COVARIANCE_UNIT);
+    covariance = Graphics::loadLEANCovariance(*lean);
     glBindTexture(GL_TEXTURE_2D, covariance);
     glActiveTexture(GL_TEXTURE0);
 
     // Load shader (reload works even the first time)
     worldData = UniformBlock<WorldData>::create();
+    hiz.initialize();
+    frameCapture.initialize();
+    glGenVertexArrays(1, &emptyVAO);
     reloadShaders();
     resize(Testbed::getScreenWidth(), Testbed::getScreenHeight());
     camera.setPosition(glm::vec3(0, 5, 0));
+    previousPosition = camera.getPosition();
+    pipeline.start(&produceFrame, &syncFrame, options.threaded);
 }
 
 void reloadShaders()
@@ -167,19 +412,29 @@ void reloadShaders()
     modelShader.release();
     terrainShader.release();
     oceanShader.release();
+    sceneryShader.release();
+    resolveShader.release();
+    deferredShader.release();
+    tiledShader.release();
+    compositeShader.release();
     
     printf("Loading shaders\n");
     GLuint modelVS = Graphics::loadShader("res/model.vert", GL_VERTEX_SHADER);
     GLuint terrainVS = Graphics::loadShader("res/terrain.vert", GL_VERTEX_SHADER);
     GLuint oceanVS = Graphics::loadShader("res/ocean.vert", GL_VERTEX_SHADER);
+    GLuint sceneryVS = Graphics::loadShader("res/scenery.vert", GL_VERTEX_SHADER);
     GLuint phong = Graphics::loadShader("res/phong.frag", GL_FRAGMENT_SHADER);
     GLuint oceanFS = Graphics::loadShader("res/ocean.frag", GL_FRAGMENT_SHADER);
-    modelShader = Graphics::createProgram({modelVS, phong});
-    terrainShader = Graphics::createProgram({terrainVS, phong});
-    oceanShader = Graphics::createProgram({oceanVS, oceanFS});
+    GLuint gbufferFS = Graphics::loadShader("res/gbuffer.frag", GL_FRAGMENT_SHADER);
+    GLuint ssrFS = Graphics::loadShader("res/ssr.frag", GL_FRAGMENT_SHADER, {"res/hiz_trace.glsl"});
+    modelShader = Graphics::createProgram({modelVS, phong, gbufferFS});
+    terrainShader = Graphics::createProgram({terrainVS, phong, gbufferFS});
+    oceanShader = Graphics::createProgram({oceanVS, oceanFS, ssrFS, gbufferFS});
+    sceneryShader = Graphics::createProgram({sceneryVS, phong, gbufferFS});
     glDeleteShader(modelVS);
     glDeleteShader(terrainVS);
     glDeleteShader(oceanVS);
+    glDeleteShader(sceneryVS);
     glDeleteShader(phong);
     glDeleteShader(oceanFS);
    
@@ -188,13 +443,65 @@ void reloadShaders()
     modelShader["light"].set(light);
     terrainShader.setBinding("WorldData", worldData.getBinding());
     terrainShader["light"].set(light);
-    terrainShader["heightmap"].set(1);
+    terrainShader["heightmap"].set(int(HEIGHTMAP_UNIT));
+    sceneryShader.setBinding("WorldData", worldData.getBinding());
+    sceneryShader["light"].set(light);
+    sceneryShader["heightmap"].set(int(HEIGHTMAP_UNIT));
     oceanShader.setBinding("WorldData", worldData.getBinding());
     oceanShader["light"].set(light);
-    oceanShader["gradient"].set(2);
-    oceanShader["covariance"].set(3);
-    oceanShader["backBuffer"].set(4);
-    oceanShader["depth"].set(5);
+    oceanShader["gradient"].set(int(GRADIENT_UNIT));
+    oceanShader["covariance"].set(int(COVARIANCE_UNIT));
+    oceanShader["backBuffer"].set(int(BACKBUFFER_UNIT));
+    oceanShader["depth"].set(int(DEPTH_UNIT));
+    oceanShader["hiz"].set(int(HIZ_UNIT));
+    oceanShader["ssrReflection"].set(int(SSR_REFLECTION_UNIT));
+    oceanShader["ssrRefraction"].set(int(SSR_REFRACTION_UNIT));
+    oceanShader["ssrSurface"].set(int(SSR_SURFACE_UNIT));
+
+    GLuint fullscreenVS = Graphics::loadShader("res/fullscreen.vert", GL_VERTEX_SHADER);
+    GLuint resolveFS = Graphics::loadShader("res/ssr_resolve.frag", GL_FRAGMENT_SHADER);
+    GLuint deferredFS = Graphics::loadShader("res/ssr_deferred.frag", GL_FRAGMENT_SHADER);
+    GLuint compositeFS = Graphics::loadShader("res/ssr_composite.frag", GL_FRAGMENT_SHADER);
+    resolveShader = Graphics::createProgram({fullscreenVS, resolveFS});
+    deferredShader = Graphics::createProgram({fullscreenVS, deferredFS, ssrFS, gbufferFS});
+    compositeShader = Graphics::createProgram({fullscreenVS, compositeFS, gbufferFS});
+    glDeleteShader(fullscreenVS);
+    glDeleteShader(resolveFS);
+    glDeleteShader(deferredFS);
+    glDeleteShader(compositeFS);
+    glDeleteShader(gbufferFS);
+    glDeleteShader(ssrFS);
+    resolveShader["currentReflection"].set(int(SSR_REFLECTION_UNIT));
+    resolveShader["currentRefraction"].set(int(SSR_REFRACTION_UNIT));
+    resolveShader["surface"].set(int(SSR_SURFACE_UNIT));
+    resolveShader["motion"].set(int(SSR_MOTION_UNIT));
+    resolveShader["historyReflection"].set(int(HISTORY_REFLECTION_UNIT));
+    resolveShader["historyRefraction"].set(int(HISTORY_REFRACTION_UNIT));
+    deferredShader.setBinding("WorldData", worldData.getBinding());
+    deferredShader["backBuffer"].set(int(BACKBUFFER_UNIT));
+    deferredShader["depth"].set(int(DEPTH_UNIT));
+    deferredShader["hiz"].set(int(HIZ_UNIT));
+    deferredShader["gbuffer"].set(int(GBUFFER_UNIT));
+    if (computeSupported)
+    {
+        GLuint tiledCS = Graphics::loadShader("res/ssr_tiled.comp", GL_COMPUTE_SHADER,
+                                                {"res/gbuffer.frag", "res/hiz_trace.glsl"});
+        tiledShader = Graphics::createProgram({tiledCS});
+        glDeleteShader(tiledCS);
+        tiledShader.setBinding("WorldData", worldData.getBinding());
+        tiledShader["backBuffer"].set(int(BACKBUFFER_UNIT));
+        tiledShader["depth"].set(int(DEPTH_UNIT));
+        tiledShader["hiz"].set(int(HIZ_UNIT));
+        tiledShader["gbuffer"].set(int(GBUFFER_UNIT));
+        tiledShader["reflectionImage"].set(0);
+        tiledShader["refractionImage"].set(1);
+    }
+    compositeShader.setBinding("WorldData", worldData.getBinding());
+    compositeShader["backBuffer"].set(int(BACKBUFFER_UNIT));
+    compositeShader["gbuffer"].set(int(GBUFFER_UNIT));
+    compositeShader["reflections"].set(int(SSR_REFLECTION_UNIT));
+    updateTraceOptions();
+    hiz.reloadShaders();
 
     glUseProgram(0);
 }
@@ -203,58 +510,290 @@ void resize(int width, int height)
 {
     printf("Resizing %dx%d\n", width, height);
     glViewport(0, 0, width, height);
-    camera.setProjection(65.0f * 3.14159 / 180.0f, float(width) / float(height), 0.1f, 100.0f);
-    dimensions = glm::vec2((float)width, (float)height);
-    
-    glActiveTexture(GL_TEXTURE4);
-    secondary = RenderTarget::create(width, height);
-    glBindTexture(GL_TEXTURE_2D, secondary.getTexture(0));
-//    glGenerateMipmap(GL_TEXTURE_2D);
-    glActiveTexture(GL_TEXTURE5);
-    printf("Bound %u and %u as back and depth textures\n", secondary.getTexture(0), secondary.getDepthTexture());
-    glBindTexture(GL_TEXTURE_2D, secondary.getDepthTexture());
-//    glGenerateMipmap(GL_TEXTURE_2D);
-    glActiveTexture(GL_TEXTURE0);
+    pending.dimensions = glm::vec2((float)width, (float)height);
+    pending.resized = true;
+
+    // Dragging the window sends a storm of these, reallocate in updateTargets once it settles
+    resizeWidth = width;
+    resizeHeight = height;
+    resizeTime = Testbed::getTime();
+}
+
+void updateTargets()
+{
+    targetPool.update();
+    if (resizeTime < 0.0) return;
+    if (targetWidth && Testbed::getTime() - resizeTime < RESIZE_DELAY) return;
+    resizeTime = -1.0;
+
+    // The graph reallocates its own targets when their description changes
+    targetWidth = resizeWidth;
+    targetHeight = resizeHeight;
+    hiz.resize(targetWidth, targetHeight);
+    allocateHistory();
+}
+
+void allocateHistory()
+{
+    targetPool.recycle(std::move(history[0]));
+    targetPool.recycle(std::move(history[1]));
+    historyValid = false;
+    if (temporal && backend == FORWARD)
+    {
+        // Accumulated over many frames, so more precision than a single trace
+        RenderTarget::Desc desc;
+        desc.width = std::max(targetWidth / ssrScale, 1);
+        desc.height = std::max(targetHeight / ssrScale, 1);
+        desc.color = {GL_RGBA16F, GL_RGBA16F};
+        desc.levels = 1;
+        desc.depth = GL_NONE;
+        for (RenderTarget& target : history)
+            target = targetPool.acquire(desc);
+    }
+    updateTraceOptions();
+    printGraph = true;
+}
+
+// Options of every program linked with ssr.frag
+void updateTraceOptions()
+{
+    bool forward = backend == FORWARD;
+    std::vector<Shader*> tracers = {&oceanShader, &deferredShader};
+    if (computeSupported) tracers.push_back(&tiledShader);
+    for (Shader* shader : tracers)
+    {
+        (*shader)["hierarchical"].set(hierarchical);
+        (*shader)["rough"].set(rough);
+        if (hiz.getLevels())
+            (*shader)["hizLevels"].set(hiz.getLevels());
+    }
+    for (Shader* shader : {&oceanShader, &deferredShader})
+    {
+        (*shader)["stride"].set(forward ? float(ssrScale) : 1.0f);
+        (*shader)["temporal"].set(temporal && forward);
+    }
 }
 
 void update(double dt)
 {
     const double period = 2.0;
     static double time = 0.0;
-    static int frames = 0;
 
+    frameStats.add(dt);
     time += dt;
-    frames++;
     if (time >= period)
     {
-        printf("Average Frame Time: %.3fms (%.2ffps)\n", 1000.0f * time / frames, frames / time);
+        frameStats.print();
+        Testbed::FrameStats::Summary latency = inputLatency.summarize();
+        if (latency.frames)
+            printf("[Input] Event to swap latency avg %.2fms p95 %.2fms\n", latency.mean, latency.p95);
+        Graphics::Profiler::print();
         time = 0;
-        frames = 0;
     }
 
+    // Replays and golden runs use a fixed timestep so every run renders the same frames
+    dt = golden.step(benchmark.step(dt));
     Input::poll();
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    // Mouse look comes straight from the event queue, in batches
+    Input::Event events[64];
+    size_t count;
+    while ((count = Input::drainEvents(events, 64)) > 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (events[i].type != Input::Event::MOUSE_MOVE) continue;
+            pending.look += glm::vec2(events[i].mouse.dx, events[i].mouse.dy);
+            if (pending.eventTime == 0.0) pending.eventTime = events[i].time;
+        }
+    }
+
+    pending.dt += dt;
+    pending.move = glm::vec2(0.0f, 0.0f);
+    if (Input::isKeyPressed(Input::KEY_W)) pending.move.x += 1.0f;
+    if (Input::isKeyPressed(Input::KEY_S)) pending.move.x -= 1.0f;
+    if (Input::isKeyPressed(Input::KEY_D)) pending.move.y += 1.0f;
+    if (Input::isKeyPressed(Input::KEY_A)) pending.move.y -= 1.0f;
+    pending.up = 0.0f;
+    if (Input::isKeyPressed(Input::KEY_SPACE)) pending.up += 1.0f;
+    if (Input::isKeyPressed(Input::KEY_LEFT_SHIFT)) pending.up -= 1.0f;
+}
+
+// Runs on the main thread while the simulation is idle
+void syncFrame()
+{
+    benchmark.apply(camera);
+    // Golden poses restart the animation at their own time, so a reference
+    // image doesn't depend on the poses before it
+    golden.apply(camera);
+    if (golden.isRunning()) previousTime = totalTime = golden.getTime();
+    input = pending;
+    pending.dt = 0.0;
+    pending.look = glm::vec2(0.0f, 0.0f);
+    pending.resized = false;
+    pending.eventTime = 0.0;
+}
+
+// Runs on the worker thread when pipelined, touches no GL state
+void produceFrame(FramePacket& packet)
+{
+    if (input.resized)
+        camera.setProjection(65.0f * 3.14159 / 180.0f, input.dimensions.x / input.dimensions.y, 0.1f, 100.0f);
+    camera.look(input.look.x * SENSITIVITY, input.look.y * SENSITIVITY);
+
+    for (int steps = timestep.advance(input.dt); steps > 0; steps--)
+        simulate(timestep.getTick());
+
+    // Render between the last two ticks, mouse look is applied immediately
+    float alpha = timestep.getAlpha();
+    glm::vec3 position = camera.getPosition();
+    camera.setPosition(glm::mix(previousPosition, position, alpha));
+    packet.world.mvp = camera.getCameraMatrix();
+    packet.world.eye = camera.getPosition();
+    packet.world.time = glm::mix(previousTime, totalTime, alpha);
+    packet.world.dim = input.dimensions;
+    static glm::mat4 lastMvp = packet.world.mvp;
+    static unsigned frameIndex = 0;
+    packet.world.prevMvp = lastMvp;
+    packet.world.frame = float(frameIndex++ % 1024);
+    lastMvp = packet.world.mvp;
+    packet.eventTime = input.eventTime;
+    camera.setPosition(position);
+
+    packet.opaque.clear();
+    packet.opaque.push_back({&model, &modelShader, false});
+    packet.opaque.push_back({&terrain, &terrainShader, true});
+
+    // Scenery shrinks away past the fade distance, what's left of each shape
+    // is one command over its run of instances
+    glm::vec2 eye(packet.world.eye.x, packet.world.eye.z);
+    packet.scenery.clear();
+    packet.sceneryCommands.clear();
+    for (int shape = 0; shape < NUM_SHAPES; shape++)
+    {
+        GLuint first = packet.scenery.size();
+        for (size_t i = sceneryFirst[shape]; i < sceneryFirst[shape + 1]; i++)
+        {
+            const SceneryInstance& instance = sceneryPlacement[i];
+            float distance = glm::length(glm::vec2(instance.transformX.w, instance.transformZ.w) - eye);
+            float lod = glm::clamp((distance - SCENERY_FADE) / (SCENERY_RANGE - SCENERY_FADE), 0.0f, 1.0f);
+            if (lod >= 1.0f) continue;
+            packet.scenery.push_back(instance);
+            packet.scenery.back().lod = lod;
+        }
+        GLuint count = packet.scenery.size() - first;
+        if (!Testbed::getOptions().arena)
+        {
+            // Indexed by shape, render() uploads each run to that shape's surface
+            packet.sceneryCommands.push_back(Graphics::GeometryArena::command(sceneryShapes[shape], count, first));
+            if (count)
+                packet.opaque.push_back({nullptr, &sceneryShader, true, nullptr, nullptr, &sceneryShapeSurfaces[shape]});
+        }
+        else if (count)
+            packet.sceneryCommands.push_back(Graphics::GeometryArena::command(sceneryShapes[shape], count, first));
+    }
+    if (Testbed::getOptions().arena && !packet.sceneryCommands.empty())
+        packet.opaque.push_back({nullptr, &sceneryShader, true, &sceneryArena, &packet.sceneryCommands});
+    packet.water.clear();
+    packet.water.push_back({&ocean, &oceanShader, false});
+}
+
+// Flat shaded mesh, every triangle gets its own vertices
+Mesh<SceneryVertex> flatMesh(const std::vector<glm::vec3>& triangles)
+{
+    Mesh<SceneryVertex> mesh = {Graphics::vertexFormat(&SceneryVertex::position, &SceneryVertex::normal), {}};
+    for (size_t i = 0; i + 2 < triangles.size(); i += 3)
+    {
+        glm::vec3 normal = glm::normalize(glm::cross(triangles[i+1] - triangles[i], triangles[i+2] - triangles[i]));
+        for (size_t j = i; j < i + 3; j++)
+        {
+            SceneryVertex vertex;
+            vertex.position = triangles[j];
+            Graphics::pack(vertex.normal, normal);
+            mesh.vertices.push_back(vertex);
+        }
+    }
+    return mesh;
+}
+
+// Scatters rocks and shrubs over the terrain, the same ones every run so
+// golden images stay comparable
+void buildScenery()
+{
+    // Shrubs are pyramids, rocks squat octahedra partly sunk into the ground
+    const glm::vec3 apex(0.0f, 1.0f, 0.0f);
+    const glm::vec3 base[4] = {{-0.5f, 0.0f, -0.5f}, {-0.5f, 0.0f, 0.5f}, {0.5f, 0.0f, 0.5f}, {0.5f, 0.0f, -0.5f}};
+    std::vector<glm::vec3> shrub;
+    for (int i = 0; i < 4; i++)
+        shrub.insert(shrub.end(), {base[i], base[(i + 1) % 4], apex});
+    shrub.insert(shrub.end(), {base[0], base[3], base[2], base[0], base[2], base[1]});
+
+    const glm::vec3 top(0.0f, 0.6f, 0.0f), bottom(0.0f, -0.3f, 0.0f);
+    const glm::vec3 equator[4] = {{-0.5f, 0.1f, 0.0f}, {0.0f, 0.1f, 0.5f}, {0.5f, 0.1f, 0.0f}, {0.0f, 0.1f, -0.5f}};
+    std::vector<glm::vec3> rock;
+    for (int i = 0; i < 4; i++)
+        rock.insert(rock.end(), {equator[i], equator[(i + 1) % 4], top, equator[(i + 1) % 4], equator[i], bottom});
+
+    std::vector<Attrib> vertices = Graphics::vertexFormat(&SceneryVertex::position, &SceneryVertex::normal);
+    std::vector<Attrib> instances = Graphics::vertexFormat(&SceneryInstance::transformX,
+        &SceneryInstance::transformY, &SceneryInstance::transformZ, &SceneryInstance::color, &SceneryInstance::lod);
+    if (Testbed::getOptions().arena)
+    {
+        sceneryArena.initialize(vertices, sizeof(SceneryVertex), 1024, 1024, Testbed::getOptions().indirect);
+        sceneryArena.setInstanceFormat(vertices.size(), instances, sizeof(SceneryInstance));
+        sceneryShapes[SHRUB] = sceneryArena.add(flatMesh(shrub));
+        sceneryShapes[ROCK] = sceneryArena.add(flatMesh(rock));
+    }
+    else
+    {
+        // One vertex array and instanced draw per shape, the arena's baseline
+        const int perShape = SCENERY_COUNT / NUM_SHAPES;
+        sceneryShapeSurfaces[SHRUB] = Graphics::createInstancedSurface<SceneryInstance>(flatMesh(shrub), instances, perShape);
+        sceneryShapeSurfaces[ROCK] = Graphics::createInstancedSurface<SceneryInstance>(flatMesh(rock), instances, perShape);
+        glBindVertexArray(0);
+        printf("[Scenery] Arena disabled, %d instanced draws\n", int(NUM_SHAPES));
+    }
+
+    std::mt19937 rng(1234);
+    auto random = [&rng]() { return (rng() >> 8) / 16777216.0f; };
+    sceneryPlacement.clear();
+    for (int shape = 0; shape < NUM_SHAPES; shape++)
+    {
+        sceneryFirst[shape] = sceneryPlacement.size();
+        glm::vec3 color = shape == ROCK ? glm::vec3(0.45f, 0.42f, 0.4f) : glm::vec3(0.2f, 0.5f, 0.15f);
+        for (int i = 0; i < SCENERY_COUNT / NUM_SHAPES; i++)
+        {
+            float yaw = random() * 6.2831853f;
+            float scale = glm::mix(0.1f, 0.3f, random());
+            glm::vec2 at = (glm::vec2(random(), random()) - 0.5f) * 40.0f;
+
+            SceneryInstance instance;
+            float c = cosf(yaw) * scale, s = sinf(yaw) * scale;
+            instance.transformX = glm::vec4(c, 0.0f, s, at.x);
+            instance.transformY = glm::vec4(0.0f, shape == SHRUB ? scale * 2.0f : scale, 0.0f, 0.0f);
+            instance.transformZ = glm::vec4(-s, 0.0f, c, at.y);
+            Graphics::pack(instance.color, glm::vec4(color, 1.0f));
+            instance.lod = 0.0f;
+            sceneryPlacement.push_back(instance);
+        }
+    }
+    sceneryFirst[NUM_SHAPES] = sceneryPlacement.size();
+    printf("[Scenery] %zu instances of %d shapes\n", sceneryPlacement.size(), int(NUM_SHAPES));
+}
+
+void simulate(double dt)
+{
+    previousPosition = camera.getPosition();
+    previousTime = totalTime;
     totalTime += dt;
 
-    glm::vec2 mvmt(0.0f, 0.0f);
-    if (Input::isKeyPressed(Input::KEY_W)) mvmt.x += 1.0f;
-    if (Input::isKeyPressed(Input::KEY_S)) mvmt.x -= 1.0f;
-    if (Input::isKeyPressed(Input::KEY_D)) mvmt.y += 1.0f;
-    if (Input::isKeyPressed(Input::KEY_A)) mvmt.y -= 1.0f;
-    glGenerateMipmap(GL_TEXTURE_2D);
+    glm::vec2 mvmt = input.move;
     if (glm::length(mvmt)) mvmt = glm::normalize(mvmt) * (float)dt * 2.0f;
 
-    float up = 0.0f;
-    if (Input::isKeyPressed(Input::KEY_SPACE)) up += (float)dt;
-    if (Input::isKeyPressed(Input::KEY_LEFT_SHIFT)) up -= (float)dt;
+    float up = input.up * (float)dt;
     
     if (mvmt.x || mvmt.y || up) camera.move(mvmt.x, mvmt.y, up);
- 
-    WorldData* data = worldData.map();
-    data->mvp = camera.getCameraMatrix();
-    data->eye = camera.getPosition();
-    data->time = totalTime;
-    data->dim = dimensions;
-    worldData.unmap();
 }
 
 // TODO move this to surface
@@ -265,38 +804,326 @@ void drawSurface(const Graphics::Surface& surf, const Shader& shader, const Rend
     Graphics::drawSurface(surf);
 }
 
-void render()
+void drawList(const std::vector<Draw>& draws, const RenderTarget& target)
 {
-    screen.clear();
-    drawSurface(model, modelShader, screen);
-    glEnable(GL_CULL_FACE);
-    drawSurface(terrain, terrainShader, screen);
-    glDisable(GL_CULL_FACE);
-    secondary.clear();
-    secondary.blit(screen, Testbed::getScreenWidth(), Testbed::getScreenHeight());
-    glActiveTexture(4);
-    glBindTexture(GL_TEXTURE_2D, secondary.getTexture(0));
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glActiveTexture(5);
-    glBindTexture(GL_TEXTURE_2D, secondary.getDepthTexture());
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glActiveTexture(0);
-//    glGenerateTextureMipmap(secondary.getTexture(0));
-//    glGenerateTextureMipmap(secondary.getDepthTexture());
-    drawSurface(ocean, oceanShader, screen);
+    for (const Draw& draw : draws)
+    {
+        if (draw.cull) glEnable(GL_CULL_FACE);
+        if (draw.arena)
+        {
+            target.activate();
+            draw.shader->use();
+            draw.arena->draw(*draw.commands);
+        }
+        else if (draw.instanced)
+        {
+            target.activate();
+            draw.shader->use();
+            Graphics::drawSurfaceInstanced(*draw.instanced);
+        }
+        else
+            drawSurface(*draw.surface, *draw.shader, target);
+        if (draw.cull) glDisable(GL_CULL_FACE);
+    }
+}
+
+// Declares this frame's passes, the graph drops what isn't needed
+void buildGraph(const FramePacket& packet)
+{
+    typedef RenderGraph::Builder Builder;
+    typedef RenderGraph::Resource Resource;
+    bool deferred = backend != FORWARD;
+    bool ssrTarget = !deferred && (ssrScale > 1 || temporal);
+
+    RenderTarget::Desc desc;
+    desc.width = targetWidth;
+    desc.height = targetHeight;
+    desc.color = {GL_R11F_G11F_B10F};   // Same size as RGB8 but keeps highlights above 1
+    if (deferred)
+        desc.color.push_back(GL_RGBA16F);
+    desc.levels = SSR_LEVELS;
+    desc.depth = GL_DEPTH_COMPONENT32F;
+    Resource scene = graph.create("scene", desc);
+    Resource output = graph.import("screen", screen, true);
+    Resource pyramid = graph.import("hiz", hiz.getTarget());
+
+    graph.addPass("Scene", [=](Builder& b) { b.write(scene); }, [=, &packet] {
+        graph.getTarget(scene).clear();
+        if (deferred)
+        {
+            // Zero linear depth marks pixels nothing was drawn to
+            const GLfloat zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            glClearBufferfv(GL_COLOR, 1, zero);
+        }
+        drawList(packet.opaque, graph.getTarget(scene));
+    });
+
+    // Averaged depth mips are useless for skipping, the pyramid keeps the nearest
+    graph.addPass("HiZ", [=](Builder& b) { b.read(scene, RenderGraph::DEPTH); b.write(pyramid); }, [=] {
+        hiz.build(graph.getTarget(scene).getDepthTexture());
+    });
+
+    // Everything a tracing ocean pass samples
+    auto traceInputs = [=](Builder& b) {
+        b.sample(scene, BACKBUFFER_UNIT, 0, true);
+        b.sample(scene, DEPTH_UNIT, RenderGraph::DEPTH);
+        if (hierarchical) b.sample(pyramid, HIZ_UNIT);
+    };
+
+    if (deferred)
+    {
+        graph.addPass("Water G-Buffer", [=](Builder& b) { b.write(scene); }, [=, &packet] {
+            // Only the G-buffer attachment, from the ocean's third output. The
+            // scene depth is left alone so tracing and refraction see under the water.
+            const GLenum buffers[] = {GL_NONE, GL_NONE, GL_COLOR_ATTACHMENT1};
+            glDrawBuffers(3, buffers);
+            glDepthMask(GL_FALSE);
+            oceanShader["ssrMode"].set(int(SSR_GBUFFER));
+            drawList(packet.water, graph.getTarget(scene));
+            glDepthMask(GL_TRUE);
+            const GLenum restore[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+            glDrawBuffers(2, restore);
+        });
+
+        // Traced color and weight, the tiled backend adds the water's refraction
+        desc.color = {GL_RGBA16F};
+        if (backend == COMPUTE)
+            desc.color.push_back(GL_RGBA16F);
+        desc.levels = 1;
+        desc.depth = GL_NONE;
+        Resource reflections = graph.create("reflections", desc);
+        glm::mat4 invMvp = glm::inverse(packet.world.mvp);  // Positions come from the stored linear depth
+        if (backend == COMPUTE)
+        {
+            graph.addPass("Tiled SSR", [=](Builder& b) {
+                traceInputs(b);
+                b.sample(scene, GBUFFER_UNIT, 1);
+                b.write(reflections);
+            }, [=] {
+                RenderTarget& target = graph.getTarget(reflections);
+                tiledShader["invMvp"].set(invMvp);
+                tiledShader.use();
+                glBindImageTexture(0, target.getTexture(0), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+                glBindImageTexture(1, target.getTexture(1), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+                glDispatchCompute((target.getWidth() + 7) / 8, (target.getHeight() + 7) / 8, 1);
+                glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+            });
+        }
+        else
+        {
+            graph.addPass("Reflections", [=](Builder& b) {
+                traceInputs(b);
+                b.sample(scene, GBUFFER_UNIT, 1);
+                b.write(reflections);
+            }, [=] {
+                glDisable(GL_DEPTH_TEST);
+                deferredShader["invMvp"].set(invMvp);
+                deferredShader.use();
+                glBindVertexArray(emptyVAO);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+                glBindVertexArray(0);
+                glEnable(GL_DEPTH_TEST);
+            });
+        }
+
+        // Takes the place of the present blit
+        graph.addPass("Composite", [=](Builder& b) {
+            b.sample(scene, BACKBUFFER_UNIT);
+            b.sample(scene, GBUFFER_UNIT, 1);
+            b.sample(reflections, SSR_REFLECTION_UNIT);
+            b.write(output);
+        }, [=] {
+            glDisable(GL_DEPTH_TEST);
+            compositeShader["invMvp"].set(invMvp);
+            compositeShader.use();
+            glBindVertexArray(emptyVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+            glEnable(GL_DEPTH_TEST);
+        });
+
+        // Refraction is water only, the fragment backend leaves it to the ocean
+        graph.addPass("Ocean", [=](Builder& b) {
+            if (backend == COMPUTE)
+            {
+                b.sample(scene, BACKBUFFER_UNIT);
+                b.sample(scene, DEPTH_UNIT, RenderGraph::DEPTH);
+                b.sample(reflections, SSR_REFRACTION_UNIT, 1);
+            }
+            else traceInputs(b);
+            b.sample(reflections, SSR_REFLECTION_UNIT);
+            b.write(output);
+        }, [=, &packet] {
+            glDisable(GL_DEPTH_TEST);
+            oceanShader["ssrMode"].set(int(backend == COMPUTE ? SSR_TILED : SSR_DEFERRED));
+            drawList(packet.water, screen);
+            glEnable(GL_DEPTH_TEST);
+        });
+        return;
+    }
+
+    Resource ssr = -1;
+    Resource traced = -1;
+    if (ssrTarget)
+    {
+        desc.width = std::max(targetWidth / ssrScale, 1);
+        desc.height = std::max(targetHeight / ssrScale, 1);
+        desc.color = {GL_R11F_G11F_B10F, GL_R11F_G11F_B10F, GL_RGBA16F, GL_RG16F};
+        desc.levels = 1;
+        desc.depth = GL_NONE;
+        ssr = traced = graph.create("ssr", desc);
+        graph.addPass("SSR", [=](Builder& b) { traceInputs(b); b.write(ssr); }, [=, &packet] {
+            // Nothing is drawn where there is no water, zero weight keeps it out of the upsample
+            const GLfloat zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (int i = 0; i < 4; i++)
+                glClearBufferfv(GL_COLOR, i, zero);
+            glDisable(GL_DEPTH_TEST);
+            oceanShader["ssrMode"].set(int(SSR_TRACE));
+            drawList(packet.water, graph.getTarget(ssr));
+            glEnable(GL_DEPTH_TEST);
+        });
+    }
+
+    if (temporal)
+    {
+        // Resolve into the current history, the upsample then reads that instead of the raw trace
+        Resource current = graph.import("history", history[historyIndex], true);
+        Resource previous = graph.import("previous history", history[historyIndex ^ 1]);
+        graph.addPass("Temporal", [=](Builder& b) {
+            b.sample(ssr, SSR_REFLECTION_UNIT, 0);
+            b.sample(ssr, SSR_REFRACTION_UNIT, 1);
+            b.sample(ssr, SSR_SURFACE_UNIT, 2);
+            b.sample(ssr, SSR_MOTION_UNIT, 3);
+            b.sample(previous, HISTORY_REFLECTION_UNIT, 0);
+            b.sample(previous, HISTORY_REFRACTION_UNIT, 1);
+            b.write(current);
+        }, [] {
+            resolveShader["reset"].set(!historyValid);
+            resolveShader.use();
+            glBindVertexArray(emptyVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+            historyValid = true;
+        });
+        traced = current;
+        historyIndex ^= 1;
+    }
+
+    // Present the scene color, the ocean tests against the sampled scene depth itself
+    graph.addBlit("Present", scene, output);
+    graph.addPass("Ocean", [=](Builder& b) {
+        if (ssrTarget)
+        {
+            b.sample(scene, BACKBUFFER_UNIT);
+            b.sample(scene, DEPTH_UNIT, RenderGraph::DEPTH);
+            b.sample(traced, SSR_REFLECTION_UNIT, 0);
+            b.sample(traced, SSR_REFRACTION_UNIT, 1);
+            b.sample(ssr, SSR_SURFACE_UNIT, 2);
+        }
+        else traceInputs(b);
+        b.write(output);
+    }, [=, &packet] {
+        glDisable(GL_DEPTH_TEST);
+        oceanShader["ssrMode"].set(int(ssrTarget ? SSR_UPSAMPLE : SSR_FULL));
+        drawList(packet.water, screen);
+        glEnable(GL_DEPTH_TEST);
+    });
+}
+
+// Queues the finished frame for readback if asked for, files are written in the background
+void captureFrame()
+{
+    using Graphics::ProfileZone;
+    ProfileZone zone("Capture");
+    static unsigned frame = 0;
+    static unsigned screenshots = 0;
+    int width = Testbed::getScreenWidth();
+    int height = Testbed::getScreenHeight();
+    char filename[256];
+    if (const char* pattern = Testbed::getOptions().capture)
+    {
+        snprintf(filename, sizeof(filename), pattern, frame);
+        frameCapture.capture(screen, width, height, filename);
+    }
+    if (screenshot)
+    {
+        snprintf(filename, sizeof(filename), "screenshot%03u.png", screenshots++);
+        if (frameCapture.capture(screen, width, height, filename))
+            printf("Saving %s\n", filename);
+        screenshot = false;
+    }
+    frameCapture.update();
+    frame++;
+}
+
+void render(const FramePacket& packet)
+{
+    using Graphics::ProfileZone;
+    Graphics::Profiler::beginFrame();
+    benchmark.beginFrame();
+    updateTargets();
+    {
+        ProfileZone frame("Frame");
+        *worldData.map() = packet.world;
+        worldData.unmap();
+        stream.stream(model, packedModel.vertices);
+        if (Testbed::getOptions().arena)
+            sceneryArena.updateInstances(packet.scenery);
+        else
+            for (size_t shape = 0; shape < packet.sceneryCommands.size(); shape++)
+            {
+                const Graphics::GeometryArena::Command& run = packet.sceneryCommands[shape];
+                Graphics::updateInstances(sceneryShapeSurfaces[shape], Buffer(packet.scenery.data() + run.baseInstance,
+                                                                              sizeof(SceneryInstance), run.instanceCount));
+            }
+        buildGraph(packet);
+        graph.execute();
+        stream.endFrame();
+        captureFrame();
+    }
+    benchmark.endFrame();
+    Graphics::Profiler::endFrame();
+    golden.endFrame(screen, Testbed::getScreenWidth(), Testbed::getScreenHeight());
     Testbed::update();
+    if (packet.eventTime > 0.0)
+        inputLatency.add(Testbed::getTime() - packet.eventTime);
+    if (printGraph)
+    {
+        graph.print();
+        printGraph = false;
+    }
 }
 
 void shutdown()
 {
-    Graphics::deleteSurface(model);
+    pipeline.stop();
     Graphics::deleteSurface(terrain);
     Graphics::deleteSurface(ocean);
+    sceneryArena.release();
+    for (Graphics::InstancedSurface& surface : sceneryShapeSurfaces)
+        if (surface.instances) Graphics::deleteSurface(surface);
     modelShader.release();
     terrainShader.release();
     oceanShader.release();
+    sceneryShader.release();
     glDeleteTextures(1, &heightmap);
-    secondary.release();
+    graph.release();
+    history[0].release();
+    history[1].release();
+    resolveShader.release();
+    deferredShader.release();
+    tiledShader.release();
+    compositeShader.release();
+    glDeleteVertexArrays(1, &emptyVAO);
+    targetPool.clear();
+    hiz.release();
+    frameCapture.release();
+    stream.release();
+    Graphics::Profiler::shutdown();
+    Testbed::Jobs::shutdown();
+    benchmark.finish();
+    golden.finish();
+    if (Testbed::getOptions().report) frameStats.write(Testbed::getOptions().report, "LEANTest");
     Graphics::shutdown();
     Testbed::shutdown();
 }
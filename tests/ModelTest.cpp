@@ -1,4 +1,5 @@
 #include "Testbed.hpp"
+#include "FrameStats.hpp"
 
 #include "Graphics.hpp"
 #include "Input.hpp"
@@ -10,7 +11,7 @@
 #include <glm/glm.hpp>
 #undef assert
 
-void initialize();
+void initialize(const Testbed::Options& options);
 void resize(int x, int y);
 void update(double dt);
 void render();
@@ -18,6 +19,7 @@ void shutdown();
 
 #define SENSITIVITY 0.01f
 Camera camera(0,0,0,0);
+Testbed::FrameStats frameStats;
 
 // Textures TODO use samplers
 GLuint heightmap;
@@ -28,7 +30,7 @@ glm::mat4 mvp;
 int main(int argc, char* argv[])
 {
     printf("%s\n", argv[0]);
-    initialize();
+    ::initialize(Testbed::parseOptions(argc, argv));
 
     double prevTime, currTime = Testbed::getTime(); // TODO wrap in timer or fpscounter class
     while (Testbed::running())
@@ -42,10 +44,10 @@ int main(int argc, char* argv[])
     shutdown();
 }
 
-void initialize()
+void initialize(const Testbed::Options& options)
 {
     // Initialize used libraries
-    Testbed::initialize();
+    Testbed::initialize(options);
     Graphics::initialize(true);
     Testbed::addResizeCallback(&resize);
     Input::addKeyPressCallback([](Input::Key key) { if (key == Input::KEY_ESCAPE) Testbed::stop(); });
@@ -97,18 +99,13 @@ void update(double dt)
 {
     const double period = 2.0;
     static double time = 0.0;
-    static int frames = 0;
 
+    frameStats.add(dt);
+    time += dt;
     if (time >= period)
     {
-        printf("Average Frame Time: %.3fms (%.2ffps)\n", 1000.0f * time / frames, frames / time);
+        frameStats.print();
         time = 0;
-        frames = 0;
-    }
-    else 
-    {
-        time += dt;
-        frames++;
     }
 
     Input::poll();
@@ -142,6 +139,7 @@ void shutdown()
 //    glDeleteTextures(1, &clr);
 //    glDeleteFramebuffers(1, &fbo);
 //    glDeleteRenderbuffers(1, &dpt);
+    if (Testbed::getOptions().report) frameStats.write(Testbed::getOptions().report, "ModelTest");
     Graphics::shutdown();
     Testbed::shutdown();
 }
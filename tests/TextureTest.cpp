@@ -1,9 +1,11 @@
 #include "Testbed.hpp"
+#include "FrameStats.hpp"
 #include "Graphics.hpp"
 #include "Input.hpp"
 #include "Shader.hpp"
 #include "Camera.hpp"
 #include "Mesh.hpp"
+#include "MeshOptimizer.hpp"
 #include "Texture.hpp"
 #include <stdio.h>
 #include <math.h>
@@ -43,6 +45,7 @@ IndexedMesh<glm::vec2> oceanData = {
 
 #define SENSITIVITY 0.01f
 Camera camera(0,0,0,0);
+Testbed::FrameStats frameStats;
 
 // Framebuffer and color/depth targets TODO wrap in RenderTarget class or something
 //GLuint fbo = 0;
@@ -124,22 +127,8 @@ void initialize()
         for (float x = -20.0f; x <= 20.0f; x += 1.0f)
             terrainData.vertices.push_back(glm::vec2(x, y));
 
-    terrainData.indices.reserve(40 * 40 * 2 * 3);
-    for (unsigned i = 0; i < 40; i++)
-    {
-        for (unsigned j = 0; j < 40; j++)
-        {
-            const unsigned width = 41;
-            unsigned index = i*width + j;
-            terrainData.indices.push_back(index);
-            terrainData.indices.push_back(index + width);
-            terrainData.indices.push_back(index + 1);
-
-            terrainData.indices.push_back(index + 1);
-            terrainData.indices.push_back(index + width);
-            terrainData.indices.push_back(index + width + 1);
-        }
-    }
+    terrainData.indices = Graphics::gridIndices(41, 41);
+    Graphics::optimizeMesh(terrainData, "terrain");
 
     terrain = Graphics::createSurface(terrainData);
     model = Graphics::createSurface(modelData);
@@ -172,14 +161,18 @@ void reloadShaders()
     GLuint oceanVS = Graphics::loadShader("res/ocean.vert", GL_VERTEX_SHADER);
     GLuint phong = Graphics::loadShader("res/phong.frag", GL_FRAGMENT_SHADER);
     GLuint oceanFS = Graphics::loadShader("res/ocean.frag", GL_FRAGMENT_SHADER);
-    modelShader = Graphics::createProgram({modelVS, phong});
-    terrainShader = Graphics::createProgram({terrainVS, phong});
-    oceanShader = Graphics::createProgram({oceanVS, oceanFS});
+    GLuint gbufferFS = Graphics::loadShader("res/gbuffer.frag", GL_FRAGMENT_SHADER);
+    GLuint ssrFS = Graphics::loadShader("res/ssr.frag", GL_FRAGMENT_SHADER, {"res/hiz_trace.glsl"});
+    modelShader = Graphics::createProgram({modelVS, phong, gbufferFS});
+    terrainShader = Graphics::createProgram({terrainVS, phong, gbufferFS});
+    oceanShader = Graphics::createProgram({oceanVS, oceanFS, ssrFS, gbufferFS});
     glDeleteShader(modelVS);
     glDeleteShader(terrainVS);
     glDeleteShader(oceanVS);
     glDeleteShader(phong);
     glDeleteShader(oceanFS);
+    glDeleteShader(gbufferFS);
+    glDeleteShader(ssrFS);
    
     glm::vec3 lightPos(0.0f, 3.0f, 0.0f);
     modelMVP = modelShader["MVP"];
@@ -225,18 +218,13 @@ void update(double dt)
 {
     const double period = 2.0;
     static double time = 0.0;
-    static int frames = 0;
 
+    frameStats.add(dt);
+    time += dt;
     if (time >= period)
     {
-        printf("Average Frame Time: %.3fms (%.2ffps)\n", 1000.0f * time / frames, frames / time);
+        frameStats.print();
         time = 0;
-        frames = 0;
-    }
-    else 
-    {
-        time += dt;
-        frames++;
     }
 
     Input::poll();
@@ -295,6 +283,7 @@ void shutdown()
 //    glDeleteTextures(1, &clr);
 //    glDeleteFramebuffers(1, &fbo);
 //    glDeleteRenderbuffers(1, &dpt);
+    if (Testbed::getOptions().report) frameStats.write(Testbed::getOptions().report, "TextureTest");
     Graphics::shutdown();
     Testbed::shutdown();
 }
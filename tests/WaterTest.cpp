@@ -1,4 +1,6 @@
 #include "Testbed.hpp"
+#include "FrameStats.hpp"
+#include "Benchmark.hpp"
 #include "Graphics.hpp"
 #include "Input.hpp"
 #include "Shader.hpp"
@@ -10,7 +12,7 @@
 #include <glm/glm.hpp>
 #undef assert
 
-void initialize();
+void initialize(const Testbed::Options& options);
 void reloadShaders();
 void resize(int x, int y);
 void update(double dt);
@@ -43,6 +45,8 @@ Mesh<glm::vec2> oceanData = {
 
 #define SENSITIVITY 0.01f
 Camera camera(0,0,0,0);
+Testbed::FrameStats frameStats;
+Testbed::Benchmark benchmark;
 
 // Framebuffer and color/depth targets TODO wrap in RenderTarget class or something
 //GLuint fbo = 0;
@@ -72,7 +76,7 @@ glm::mat4 mvp;
 
 int main(int argc, char* argv[])
 {
-    initialize();
+    ::initialize(Testbed::parseOptions(argc, argv));
 
     double prevTime, currTime = Testbed::getTime(); // TODO wrap in timer or fpscounter class
     while (Testbed::running())
@@ -86,12 +90,13 @@ int main(int argc, char* argv[])
     shutdown();
 }
 
-void initialize()
+void initialize(const Testbed::Options& options)
     
 {
     // Initialize used libraries
-    Testbed::initialize();
+    Testbed::initialize(options);
     Graphics::initialize(true);
+    benchmark.initialize(options);
     Testbed::addResizeCallback(&resize);
     Input::addKeyPressCallback([](Input::Key key) { if (key == Input::KEY_ESCAPE) Testbed::stop(); });
     Input::addKeyPressCallback([](Input::Key key) { if (key == Input::KEY_R) reloadShaders(); });
@@ -145,13 +150,15 @@ void reloadShaders()
     GLuint terrainVS = Graphics::loadShader("res/terrain.vert", GL_VERTEX_SHADER);
     GLuint oceanVS = Graphics::loadShader("res/ocean.vert", GL_VERTEX_SHADER);
     GLuint phong = Graphics::loadShader("res/phong.frag", GL_FRAGMENT_SHADER);
-    shaderModel = Graphics::createProgram({modelVS, phong});
-    shaderTerrain = Graphics::createProgram({terrainVS, phong});
-    shaderOcean = Graphics::createProgram({oceanVS, phong});
+    GLuint gbuffer = Graphics::loadShader("res/gbuffer.frag", GL_FRAGMENT_SHADER);
+    shaderModel = Graphics::createProgram({modelVS, phong, gbuffer});
+    shaderTerrain = Graphics::createProgram({terrainVS, phong, gbuffer});
+    shaderOcean = Graphics::createProgram({oceanVS, phong, gbuffer});
     glDeleteShader(modelVS);
     glDeleteShader(terrainVS);
     glDeleteShader(oceanVS);
     glDeleteShader(phong);
+    glDeleteShader(gbuffer);
     
     glUseProgram(shaderModel);
     mvpModel = glGetUniformLocation(shaderModel, "MVP");
@@ -188,20 +195,17 @@ void update(double dt)
 {
     const double period = 2.0;
     static double time = 0.0;
-    static int frames = 0;
 
+    frameStats.add(dt);
+    time += dt;
     if (time >= period)
     {
-        printf("Average Frame Time: %I.3fms (%.2ffps)\n", 1000.0f * time / frames, frames / time);
+        frameStats.print();
         time = 0;
-        frames = 0;
-    }
-    else 
-    {
-        time += dt;
-        frames++;
     }
 
+    // Replays run on a fixed timestep so every run renders the same frames
+    dt = benchmark.step(dt);
     Input::poll();
 
     glm::vec2 mvmt(0.0f, 0.0f);
@@ -216,6 +220,7 @@ void update(double dt)
     if (Input::isKeyPressed(Input::KEY_LEFT_SHIFT)) up -= (float)dt;
     
     if (mvmt.x || mvmt.y || up) camera.move(mvmt.x, mvmt.y, up); 
+    benchmark.apply(camera);
     mvp = camera.getCameraMatrix();
   //glUniformMatrix4fv(mvpOcean, 1, GL_FALSE, &mvp[0][0]);
 }
@@ -230,10 +235,12 @@ void drawSurface(const Graphics::Surface& surf, GLuint program, GLuint mvpHandle
 
 void render()
 {   
+    benchmark.beginFrame();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     drawSurface(model, shaderModel, mvpModel);
     drawSurface(terrain, shaderTerrain, mvpTerrain);
     drawSurface(ocean, shaderOcean, mvpOcean);
+    benchmark.endFrame();
     Testbed::update();
 }
 
@@ -249,6 +256,8 @@ void shutdown()
 //    glDeleteTextures(1, &clr);
 //    glDeleteFramebuffers(1, &fbo);
 //    glDeleteRenderbuffers(1, &dpt);
+    benchmark.finish();
+    if (Testbed::getOptions().report) frameStats.write(Testbed::getOptions().report, "WaterTest");
     Graphics::shutdown();
     Testbed::shutdown();
 }
@@ -6,7 +6,7 @@
 
 int main(int argc, char* argv[])
 {
-    Testbed::initialize();
+    Testbed::initialize(Testbed::parseOptions(argc, argv));
     Graphics::initialize(true);
 
     Graphics::printContextData();